@@ -0,0 +1,12 @@
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o shader_dispatch ^
+ "src/bench/shader_dispatch.cpp" "src/parser.cpp" "src/mapped_file.cpp" "src/mesh_cache.cpp" "src/mat_vec.cpp" "src/tgaimage.cpp" "src/image_writer.cpp" "src/renderer.cpp" "src/thread_pool.cpp"
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o depth_formats ^
+ "src/bench/depth_formats.cpp" "src/parser.cpp" "src/mapped_file.cpp" "src/mesh_cache.cpp" "src/mat_vec.cpp" "src/tgaimage.cpp" "src/image_writer.cpp" "src/renderer.cpp" "src/thread_pool.cpp"
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o obj_parser ^
+ "src/bench/obj_parser.cpp" "src/parser.cpp" "src/mapped_file.cpp" "src/mesh_cache.cpp" "src/mat_vec.cpp" "src/thread_pool.cpp"
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o tga_rle ^
+ "src/bench/tga_rle.cpp" "src/tgaimage.cpp" "src/mapped_file.cpp" "src/thread_pool.cpp"
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o image_writer ^
+ "src/bench/image_writer.cpp" "src/image_writer.cpp" "src/tgaimage.cpp" "src/mapped_file.cpp" "src/thread_pool.cpp"
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o batch_views ^
+ "src/bench/batch_views.cpp" "src/parser.cpp" "src/mapped_file.cpp" "src/mesh_cache.cpp" "src/mat_vec.cpp" "src/tgaimage.cpp" "src/image_writer.cpp" "src/renderer.cpp" "src/thread_pool.cpp"
@@ -1,2 +1,2 @@
 g++ -g -static-libstdc++ -std=c++23 -Wall -Wextra ^
- "src/main.cpp" "src/parser.cpp" "src/mat_vec.cpp" "src/tgaimage.cpp" "src/renderer.cpp"
+ "src/main.cpp" "src/parser.cpp" "src/mapped_file.cpp" "src/mesh_cache.cpp" "src/mat_vec.cpp" "src/tgaimage.cpp" "src/image_writer.cpp" "src/renderer.cpp" "src/thread_pool.cpp"
@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "depth.h"
+#include "image.h"
+#include "image_writer.h"
+#include "mat_vec.h"
+#include "multisample.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "thread_pool.h"
+#include "tiled_renderer.h"
+
+// Settings of render_batch
+struct BatchOptions {
+	int width = 1000;
+	int height = 1000;
+	int samples = 1; // Of the anti-aliasing: 1, 2, 4 or 8
+	std::uint32_t background = 0xff000000;
+	mat<4, 4> model = mat<4, 4>::identity(); // Applied before the look_at of every view
+	// The views are written into <prefix><index of the view, 4 digits>.ppm or .png
+	std::string prefix = "view_";
+	ImageFormat format = ImageFormat::ppm;
+	DrawOptions draw {}; // rows_done and setup_uniforms are taken by render_batch
+};
+
+// Framebuffers of a worker of render_batch, cleared and reused by all of its views
+template <class depth_T> struct BatchFrame {
+	BatchFrame(int width, int height, int samples)
+		: target(width, height, samples)
+		, canvas(width, height)
+	{
+	}
+
+	MultisampleTarget<std::uint32_t, depth_T> target;
+	Image<std::uint32_t> canvas;
+};
+
+inline std::string batch_view_path(const BatchOptions& options, int view)
+{
+	std::string index = std::to_string(view);
+	index.insert(0, index.size() < 4 ? 4 - index.size() : 0, '0');
+	return options.prefix + index + (options.format == ImageFormat::png ? ".png" : ".ppm");
+}
+
+// Renders the model of ShaderGlobals from every view into the numbered files of options
+// The views are handed out to the workers of the pool, every worker draws its views on its own thread
+// (draw_tiled_indexed on a pool of one) into a frame it allocates once, so that views render
+// concurrently without synchronization inside a draw; a batch holds pool.size() frames
+// Finished rows are resolved and streamed into the file of the view while the rest of it is drawn
+// The light and the projection are those of ShaderGlobals, the viewport covers the frame and
+// the model view is look_at(view)*options.model, every view sets them up on its own copy of the shader
+// through setup_uniforms(camera), the globals are left untouched
+// returns 0, or -1 if a view could not be written
+template <class depth_T, class Shader>
+	requires FragmentShader<Shader, std::uint32_t> && IndexedVertexShader<Shader>
+	&& requires(Shader& shader, const ShaderCamera<shader_scalar_t<Shader>>& camera) { shader.setup_uniforms(camera); }
+int render_batch(const std::vector<CameraView>& views, const Shader& shader, const BatchOptions& options, ThreadPool& pool)
+{
+	using T = shader_scalar_t<Shader>;
+	ShaderCamera<T> camera = ShaderGlobals<T>::camera();
+	camera.Viewport = mat_cast<T>(get_viewport(0, 0, options.width, options.height, DEPTH_RANGE));
+
+	std::vector<std::unique_ptr<BatchFrame<depth_T>>> frames(pool.size());
+	std::vector<std::unique_ptr<ThreadPool>> worker_pools(pool.size());
+	std::atomic<int> failed { 0 };
+	pool.parallel_for(views.size(), [&](int view, unsigned int worker) {
+		if (!frames[worker]) {
+			frames[worker] = std::make_unique<BatchFrame<depth_T>>(options.width, options.height, options.samples);
+			worker_pools[worker] = std::make_unique<ThreadPool>(1);
+		}
+		BatchFrame<depth_T>& frame = *frames[worker];
+		ShaderCamera<T> view_camera = camera;
+		view_camera.ModelView = mat_cast<T>(look_at(views[view].eye, views[view].center, views[view].up) * options.model);
+		Shader view_shader = shader;
+		view_shader.setup_uniforms(view_camera);
+
+		img_fill(frame.target.color, options.background);
+		clear_depth(frame.target.depth);
+		ImageRowStream output(batch_view_path(options, view), options.width, options.height, options.format);
+		DrawOptions draw = options.draw;
+		draw.setup_uniforms = false;
+		draw.rows_done = [&](int y_begin, int y_end) {
+			resolve(frame.target, frame.canvas, y_begin, y_end);
+			output.write_rows(frame.canvas, y_begin, y_end);
+		};
+		draw_tiled_indexed(ShaderGlobals<T>::mdl.vertex_index, view_shader, frame.target, *worker_pools[worker], draw);
+		if (output.close())
+			failed++;
+	});
+	return failed ? -1 : 0;
+}
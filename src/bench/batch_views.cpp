@@ -0,0 +1,93 @@
+// Compares the throughput of render_batch against drawing the same orbit one view at a time
+// with the whole pool on every draw, the way main renders its single view
+// both write the views next to the binary and have to give the same files
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../batch_renderer.h"
+#include "../depth.h"
+#include "../image.h"
+#include "../image_writer.h"
+#include "../mapped_file.h"
+#include "../mat_vec.h"
+#include "../model.h"
+#include "../multisample.h"
+#include "../parser.h"
+#include "../renderer.h"
+#include "../shaders.h"
+#include "../thread_pool.h"
+#include "../tiled_renderer.h"
+
+#define WIDTH  (512)
+#define HEIGHT (512)
+#define SAMPLES (4)
+#define VIEWS (32)
+
+bool same_file(const std::string& a, const std::string& b)
+{
+	MappedFile fa(a);
+	MappedFile fb(b);
+	return fa.is_open() && fb.is_open() && fa.size() == fb.size() && std::equal(fa.data(), fa.data() + fa.size(), fb.data());
+}
+
+int main()
+{
+	if (parse_obj("./res/diablo3_pose.obj", &mdl) == -1) {
+		std::cerr << "Could not load ./res/diablo3_pose.obj\n";
+		return -1;
+	}
+	double longest = 0;
+	for (auto pos : mdl.verts) longest = std::max(longest, pos.norm());
+	mdl.transform_positions([&](auto pos) { return pos/(0.8*longest); });
+
+	light_dir  = {0.5, 0.0, 1.0};
+	Projection = get_projection(3);
+	Viewport   = get_viewport(0, 0, WIDTH, HEIGHT, DEPTH_RANGE);
+
+	PhongShader shader{};
+	shader.uniform_ambient = 5;
+	ThreadPool pool;
+	const std::vector<CameraView> views = orbit_views(vec3{1.0, 0.4, 1.0}, vec3{0, 0, 0}, vec3{0, 1, 0}, VIEWS);
+	const DrawOptions options = { .cull = CullMode::cw, .deferred = true };
+
+	BatchOptions sequential = { .width = WIDTH, .height = HEIGHT, .samples = SAMPLES, .model = scale(0.7),
+		.prefix = "./batch_views_sequential_", .draw = options };
+	auto begin = std::chrono::high_resolution_clock::now();
+	MultisampleTarget<std::uint32_t, float> target(WIDTH, HEIGHT, SAMPLES);
+	Image<std::uint32_t> canvas(WIDTH, HEIGHT);
+	for (int view = 0; view < VIEWS; view++) {
+		ModelView = look_at(views[view].eye, views[view].center, views[view].up)*sequential.model;
+		img_fill(target.color, (std::uint32_t)0xff000000);
+		clear_depth(target.depth);
+		draw_tiled_indexed(mdl.vertex_index, shader, target, pool, options);
+		resolve(target, canvas);
+		write_ppm(batch_view_path(sequential, view), canvas);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	const double sequential_s = ((std::chrono::duration<double>)(end - begin)).count();
+
+	BatchOptions batch = sequential;
+	batch.prefix = "./batch_views_batch_";
+	begin = std::chrono::high_resolution_clock::now();
+	if (render_batch<float>(views, shader, batch, pool)) {
+		std::cerr << "render_batch could not write the views\n";
+		return -1;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	const double batch_s = ((std::chrono::duration<double>)(end - begin)).count();
+
+	for (int view = 0; view < VIEWS; view++) {
+		if (!same_file(batch_view_path(sequential, view), batch_view_path(batch, view))) {
+			std::cerr << "View " << view << " differs between the batch and the sequential draws\n";
+			return -1;
+		}
+	}
+	std::cout << VIEWS << " views of " << WIDTH << "x" << HEIGHT << " with " << SAMPLES << " samples on "
+			  << pool.size() << " threads\n";
+	std::cout << "  one view at a time: " << VIEWS / sequential_s << " views/s\n";
+	std::cout << "  render_batch:       " << VIEWS / batch_s << " views/s, " << sequential_s / batch_s << "x\n";
+	return 0;
+}
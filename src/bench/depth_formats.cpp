@@ -0,0 +1,89 @@
+// Compares the zbuffer formats of "depth.h" on a 4K frame
+// every format draws the same scene through draw_tiled, the clear and the draw are timed separately
+// and the image is checked against the one drawn with the double zbuffer
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+
+#include "../depth.h"
+#include "../image.h"
+#include "../mat_vec.h"
+#include "../model.h"
+#include "../parser.h"
+#include "../renderer.h"
+#include "../shaders.h"
+#include "../thread_pool.h"
+#include "../tiled_renderer.h"
+
+#define WIDTH  (3840)
+#define HEIGHT (2160)
+#define FRAMES (10)
+
+// Renders FRAMES frames with a depth_T zbuffer, prints the average times
+// and how many pixels differ from the reference image
+template <class depth_T>
+void time_format(const std::string& name, PhongShader<>& shader, ThreadPool& pool, Image<std::uint32_t>& reference)
+{
+	Image<std::uint32_t> pixels(WIDTH, HEIGHT);
+	Image<depth_T> zbuffer(WIDTH, HEIGHT);
+	double clear_ms = 0;
+	double draw_ms = 0;
+	for (int frame = 0; frame < FRAMES; frame++) {
+		img_fill(pixels, (std::uint32_t)0xFF000000);
+		auto begin = std::chrono::high_resolution_clock::now();
+		clear_depth(zbuffer);
+		auto cleared = std::chrono::high_resolution_clock::now();
+		draw_tiled(mdl.nfaces(), shader, pixels, zbuffer, pool);
+		auto end = std::chrono::high_resolution_clock::now();
+		clear_ms += ((std::chrono::duration<double, std::milli>)(cleared - begin)).count();
+		draw_ms += ((std::chrono::duration<double, std::milli>)(end - cleared)).count();
+	}
+
+	std::cout << name << ": " << zbuffer.nbytes() / (1024 * 1024) << " MB, clear " << clear_ms / FRAMES
+			  << " ms, draw " << draw_ms / FRAMES << " ms";
+	if constexpr (std::is_same_v<depth_T, double>) {
+		for (unsigned int i = 0; i < pixels.width * pixels.height; i++) {
+			reference[i] = pixels[i];
+		}
+		std::cout << '\n';
+	} else {
+		// The shaders leave the alpha channel alone, so only the color is compared
+		int differing = 0;
+		for (unsigned int i = 0; i < pixels.width * pixels.height; i++) {
+			differing += ((pixels[i] ^ reference[i]) & 0x00ffffff) != 0;
+		}
+		std::cout << ", " << differing << " pixels differ from double\n";
+	}
+}
+
+int main()
+{
+	if (parse_obj("./res/diablo3_pose.obj", &mdl) == -1) {
+		std::cerr << "Could not load ./res/diablo3_pose.obj\n";
+		return -1;
+	}
+	double longest = 0;
+	for (auto pos : mdl.verts) longest = std::max(longest, pos.norm());
+	mdl.transform_positions([&](auto pos) { return pos/(0.8*longest); });
+
+	light_dir  = {0.5, 0.0, 1.0};
+	ModelView  = look_at(vec3{1.0, 0.4, 1.0}, vec3{0, 0, 0}, vec3{0, 1, 0})*scale(0.7);
+	Projection = get_projection(3);
+	Viewport   = get_viewport(0, 0, WIDTH, HEIGHT, DEPTH_RANGE);
+
+	PhongShader shader{};
+	shader.uniform_ambient = 5;
+
+	ThreadPool pool;
+	Image<std::uint32_t> reference(WIDTH, HEIGHT);
+	time_format<double>("double", shader, pool, reference);
+	time_format<float>("float", shader, pool, reference);
+	time_format<ReversedFloatDepth>("float reversed", shader, pool, reference);
+	time_format<FixedDepth<24>>("24-bit fixed", shader, pool, reference);
+	time_format<FixedDepth<24, true>>("24-bit fixed reversed", shader, pool, reference);
+	time_format<FixedDepth<32>>("32-bit fixed", shader, pool, reference);
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+// Compares the writers of "image_writer.h" against the old img_save, 3 bytes per write
+// on a 4K canvas with flat areas and noise, every file is read back and checked against the canvas
+// the files are written next to the binary
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../image.h"
+#include "../image_writer.h"
+#include "../mapped_file.h"
+#include "../tgaimage.h"
+#include "../thread_pool.h"
+
+#define WIDTH  (3840)
+#define HEIGHT (2160)
+#define REPEATS (5)
+// Rows per write_rows call of the streamed file, a row of tiles
+#define BAND_ROWS (32)
+
+// The old img_save
+int reference_save(const std::string& filepath, const Image<std::uint32_t>& canvas)
+{
+	std::uint8_t bytes[3] { 0, 0, 0 };
+	std::ofstream file;
+	file.open(filepath, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return -1;
+	file << "P6\n" << canvas.width << " " << canvas.height << " " << "255" << "\n";
+	for (unsigned int i = 0; i < canvas.width * canvas.height; i++) {
+		bytes[0] = (canvas.data[i] >> (8 * 0)) & 0xff;
+		bytes[1] = (canvas.data[i] >> (8 * 1)) & 0xff;
+		bytes[2] = (canvas.data[i] >> (8 * 2)) & 0xff;
+		file.write((char*)bytes, 3 * (sizeof(*bytes)));
+	}
+	return 0;
+}
+
+// Average milliseconds of REPEATS calls of fn
+template <class Fn> double time_ms(Fn&& fn)
+{
+	auto begin = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < REPEATS; i++)
+		fn();
+	auto end = std::chrono::high_resolution_clock::now();
+	return ((std::chrono::duration<double, std::milli>)(end - begin)).count() / REPEATS;
+}
+
+std::size_t file_size(const std::string& filepath)
+{
+	MappedFile file(filepath);
+	return file.is_open() ? file.size() : 0;
+}
+
+bool same_file(const std::string& a, const std::string& b)
+{
+	MappedFile fa(a);
+	MappedFile fb(b);
+	return fa.is_open() && fb.is_open() && fa.size() == fb.size() && std::equal(fa.data(), fa.data() + fa.size(), fb.data());
+}
+
+int main()
+{
+	ThreadPool pool;
+	// Gradients in the top half, noise in the bottom one
+	Image<std::uint32_t> canvas(WIDTH, HEIGHT);
+	std::mt19937 rng(1);
+	for (unsigned int y = 0; y < canvas.height; y++) {
+		for (unsigned int x = 0; x < canvas.width; x++)
+			canvas.data[y * canvas.width + x] = 0xff000000u | (y < HEIGHT / 2 ? (x / 16) * 0x010203u : rng() & 0xffffff);
+	}
+
+	const double reference_ms = time_ms([&] { reference_save("./image_writer_reference.ppm", canvas); });
+	const double ppm_ms = time_ms([&] { write_ppm("./image_writer.ppm", canvas); });
+	const double png_store_ms = time_ms([&] { write_png("./image_writer_store.png", canvas, PngCompression::store); });
+	const double png_fast_ms = time_ms([&] { write_png("./image_writer_fast.png", canvas, PngCompression::fast); });
+	const double tga_ms = time_ms([&] { write_tga("./image_writer.tga", canvas, true, &pool); });
+	// Bands in reverse order, every one but the last waits in the stream
+	const double stream_ms = time_ms([&] {
+		ImageRowStream stream("./image_writer_stream.ppm", WIDTH, HEIGHT);
+		for (int y = (HEIGHT - 1) / BAND_ROWS * BAND_ROWS; y >= 0; y -= BAND_ROWS)
+			stream.write_rows(canvas, y, std::min(y + BAND_ROWS, HEIGHT));
+		stream.close();
+	});
+
+	Image<std::uint32_t> tga(TGAFile("./image_writer.tga"));
+	if (!same_file("./image_writer_reference.ppm", "./image_writer.ppm")
+		|| !same_file("./image_writer.ppm", "./image_writer_stream.ppm")
+		|| !std::equal(tga.data.get(), tga.data.get() + WIDTH * HEIGHT, canvas.data.get())) {
+		std::cerr << "The written files do not match the canvas\n";
+		return -1;
+	}
+
+	std::cout << WIDTH << "x" << HEIGHT << " canvas\n";
+	std::cout << "  img_save per pixel: " << reference_ms << " ms\n";
+	std::cout << "  write_ppm:          " << ppm_ms << " ms, " << reference_ms / ppm_ms << "x\n";
+	std::cout << "  streamed ppm:       " << stream_ms << " ms\n";
+	std::cout << "  png store:          " << png_store_ms << " ms, " << file_size("./image_writer_store.png") << " bytes\n";
+	std::cout << "  png fast:           " << png_fast_ms << " ms, " << file_size("./image_writer_fast.png") << " bytes\n";
+	std::cout << "  tga rle on " << pool.size() << " threads: " << tga_ms << " ms, "
+			  << file_size("./image_writer.tga") << " bytes\n";
+	return 0;
+}
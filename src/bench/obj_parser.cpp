@@ -0,0 +1,137 @@
+// Compares the in-place parser of "parser.h" against the std::getline/std::stof loop it replaced
+// on a large .obj made of copies of the bundled head, written next to the binary on the first run
+// and the chunked parse on a ThreadPool against both, only the parsing is timed, the tangents and the vertex index are left out of both
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "../mapped_file.h"
+#include "../model.h"
+#include "../parser.h"
+#include "../thread_pool.h"
+
+#define SOURCE "./res/african_head.obj"
+#define BENCH_OBJ "./obj_parser_bench.obj"
+#define SIZE_MB (256)
+
+// The old parse_obj: a string per line, a substring per keyword and per number
+void reference_parse(const std::string& filepath, Model* mdl)
+{
+	std::ifstream file(filepath, std::ios::in);
+	std::string line;
+	while (std::getline(file, line, '\n')) {
+		const std::string line_state = line.substr(0, 2);
+		if (line_state == "v " || line_state == "vn") {
+			std::size_t idx = line.find(' ');
+			vec3 v;
+			for (int i = 0; i < 3; i++) {
+				idx = line.find_first_not_of(' ', idx);
+				v[i] = std::stof(line.substr(idx));
+				idx = line.find(' ', idx);
+			}
+			if (line_state == "v ")
+				mdl->verts.push_back(v);
+			else
+				mdl->normals.push_back(v / v.norm());
+		} else if (line_state == "vt") {
+			std::size_t idx = line.find_first_not_of(' ', 2);
+			vec3 uv;
+			uv.x = std::stof(line.substr(idx));
+			idx = line.find_first_not_of(' ', line.find(' ', idx));
+			uv.y = std::stof(line.substr(idx));
+			mdl->tex_coords.push_back(uv);
+		} else if (line_state == "f ") {
+			std::size_t idx = 1;
+			for (int corner = 0; corner < 3; corner++) {
+				idx = line.find_first_not_of(' ', idx);
+				mdl->face_vrtx.push_back(std::stoi(line.substr(idx)) - 1);
+				idx = line.find('/', idx) + 1;
+				mdl->face_tex.push_back(std::stoi(line.substr(idx)) - 1);
+				idx = line.find('/', idx) + 1;
+				mdl->face_norm.push_back(std::stoi(line.substr(idx)) - 1);
+				idx = line.find(' ', idx);
+			}
+		}
+	}
+}
+
+// Writes copies of SOURCE until the file reaches SIZE_MB, the face indices of every copy are offset
+bool write_bench_obj()
+{
+	Model head;
+	if (parse_obj(SOURCE, &head) == -1)
+		return false;
+	std::ofstream out(BENCH_OBJ, std::ios::out | std::ios::binary);
+	if (!out.is_open()) {
+		std::cerr << "Could not write " << BENCH_OBJ << '\n';
+		return false;
+	}
+	for (int copy = 0; out.tellp() < (std::streamoff)SIZE_MB * 1024 * 1024; copy++) {
+		out << "o copy" << copy << '\n';
+		for (const vec3& v : head.verts)
+			out << "v " << v.x + 2 * copy << ' ' << v.y << ' ' << v.z << '\n';
+		for (const vec3& uv : head.tex_coords)
+			out << "vt " << uv.x << ' ' << uv.y << " 0\n";
+		for (const vec3& n : head.normals)
+			out << "vn " << n.x << ' ' << n.y << ' ' << n.z << '\n';
+		for (int face = 0; face < head.nfaces(); face++) {
+			out << 'f';
+			for (int i = 0; i < 3; i++) {
+				out << ' ' << head.face_vrtx[3 * face + i] + 1 + copy * (int)head.verts.size() << '/'
+					<< head.face_tex[3 * face + i] + 1 + copy * (int)head.tex_coords.size() << '/'
+					<< head.face_norm[3 * face + i] + 1 + copy * (int)head.normals.size();
+			}
+			out << '\n';
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	if (!MappedFile(BENCH_OBJ).is_open() && !write_bench_obj())
+		return -1;
+
+	Model reference;
+	auto begin = std::chrono::high_resolution_clock::now();
+	reference_parse(BENCH_OBJ, &reference);
+	auto end = std::chrono::high_resolution_clock::now();
+	const double reference_s = ((std::chrono::duration<double>)(end - begin)).count();
+
+	Model mdl;
+	begin = std::chrono::high_resolution_clock::now();
+	MappedFile file(BENCH_OBJ);
+	const ObjResult result = parse_obj_text(file.data(), file.size(), &mdl);
+	end = std::chrono::high_resolution_clock::now();
+	const double parse_s = ((std::chrono::duration<double>)(end - begin)).count();
+	if (!result) {
+		std::cerr << "Parse failed on line " << result.line << ": " << obj_error_message(result.error) << '\n';
+		return -1;
+	}
+
+	ThreadPool pool;
+	Model chunked;
+	begin = std::chrono::high_resolution_clock::now();
+	const ObjResult chunked_result = parse_obj_text(file.data(), file.size(), &chunked, pool);
+	end = std::chrono::high_resolution_clock::now();
+	const double chunked_s = ((std::chrono::duration<double>)(end - begin)).count();
+
+	const double mb = file.size() / (1024.0 * 1024.0);
+	std::cout << BENCH_OBJ << ": " << mb << " MB, " << mdl.nfaces() << " faces\n";
+	std::cout << "getline/stof: " << reference_s << " s, " << mb / reference_s << " MB/s\n";
+	std::cout << "in place: " << parse_s << " s, " << mb / parse_s << " MB/s, " << reference_s / parse_s << "x\n";
+	std::cout << "chunked on " << pool.size() << " threads: " << chunked_s << " s, " << mb / chunked_s << " MB/s, "
+			  << reference_s / chunked_s << "x\n";
+	if (mdl.verts.size() != reference.verts.size() || mdl.face_vrtx != reference.face_vrtx
+		|| mdl.face_tex != reference.face_tex || mdl.face_norm != reference.face_norm) {
+		std::cout << "The parsers disagree\n";
+		return -1;
+	}
+	if (!chunked_result || chunked_result.lines != result.lines || chunked.verts.size() != mdl.verts.size()
+		|| chunked.face_vrtx != mdl.face_vrtx || chunked.face_tex != mdl.face_tex || chunked.face_norm != mdl.face_norm) {
+		std::cout << "The chunked parse disagrees\n";
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,98 @@
+// Compares the devirtualized draw path (shader passed as its final type)
+// against the virtual fallback (shader passed as ShaderClass<std::uint32_t>&)
+// on the bundled models, single-threaded so only the dispatch differs
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "../image.h"
+#include "../mat_vec.h"
+#include "../model.h"
+#include "../parser.h"
+#include "../renderer.h"
+#include "../shaders.h"
+#include "../texture.h"
+#include "../tgaimage.h"
+
+#define WIDTH  (1000)
+#define HEIGHT (1000)
+#define FRAMES (10)
+
+// Renders FRAMES frames and returns the average frame time in milliseconds
+template <class Shader>
+double time_frames(Shader& shader, Image<std::uint32_t>& pixels, Image<double>& zbuffer)
+{
+	std::array<vec4, 3> screen_coords;
+	setup_shader_uniforms(shader);
+	auto begin = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < FRAMES; frame++) {
+		img_fill(pixels, (std::uint32_t)0xFF000000);
+		img_fill(zbuffer, std::numeric_limits<double>::lowest());
+		for (int face = 0; face < mdl.nfaces(); face++) {
+			for (int nthvert = 0; nthvert < 3; nthvert++) {
+				screen_coords[nthvert] = shader.vertex(3 * face, nthvert);
+			}
+			draw_shaded_triangle(screen_coords, shader, pixels, zbuffer);
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	return ((std::chrono::duration<double, std::milli>)(end - begin)).count() / FRAMES;
+}
+
+template <class Shader>
+void compare(const std::string& name, Shader& shader, Image<std::uint32_t>& pixels, Image<double>& zbuffer)
+{
+	double static_ms = time_frames(shader, pixels, zbuffer);
+	double virtual_ms = time_frames((ShaderClass<std::uint32_t>&)shader, pixels, zbuffer);
+	std::cout << name << ": static " << static_ms << " ms, virtual " << virtual_ms << " ms, speedup "
+			  << virtual_ms / static_ms << "x\n";
+}
+
+bool load_model(const std::string& filepath)
+{
+	mdl = Model();
+	if (parse_obj(filepath, &mdl) == -1) {
+		std::cerr << "Could not load " << filepath << '\n';
+		return false;
+	}
+	double longest = 0;
+	for (auto pos : mdl.verts) longest = std::max(longest, pos.norm());
+	mdl.transform_positions([&](auto pos) { return pos/(0.8*longest); });
+	return true;
+}
+
+int main()
+{
+	Image<std::uint32_t> pixels(WIDTH, HEIGHT);
+	Image<double> zbuffer(WIDTH, HEIGHT);
+
+	light_dir  = {0.5, 0.0, 1.0};
+	ModelView  = look_at(vec3{1.0, 0.4, 1.0}, vec3{0, 0, 0}, vec3{0, 1, 0})*scale(0.7);
+	Projection = get_projection(3);
+	Viewport   = get_viewport(0, 0, WIDTH, HEIGHT, 255);
+
+	PhongShader phong{};
+	phong.uniform_ambient = 5;
+
+	for (std::string name : {"african_head", "body", "diablo3_pose"}) {
+		if (!load_model("./res/" + name + ".obj")) return -1;
+		compare(name + " PhongShader", phong, pixels, zbuffer);
+	}
+
+	if (!load_model("./res/african_head.obj")) return -1;
+	Texture<std::uint32_t> texture(Image<std::uint32_t>(TGAFile("./res/african_head_diffuse.tga")));
+	Texture<vec<3,float>> tangent_normals(Image<std::uint32_t>(TGAFile("./res/african_head_nm_tangent.tga")), decode_normal);
+	Texture<float> specular(Image<std::uint32_t>(TGAFile("./res/african_head_spec.tga")), decode_red);
+	mdl.m_texturemap = &texture;
+	mdl.m_normalmap = &tangent_normals;
+	mdl.m_specularmap = &specular;
+
+	TextureTangentNormalShader tangent{};
+	tangent.uniform_ambient = 5;
+	compare("african_head TextureTangentNormalShader", tangent, pixels, zbuffer);
+
+	return 0;
+}
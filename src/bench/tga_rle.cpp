@@ -0,0 +1,179 @@
+// Compares the RLE codec of "tgaimage.h" against the stream-based one it replaced
+// on every bundled texture: both encoders and decoders have to round-trip the pixels,
+// the new writer has to give the same file with and without a ThreadPool
+// the codecs are timed on memory, the writers on top-left origin files next to the binary
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../mapped_file.h"
+#include "../tgaimage.h"
+#include "../thread_pool.h"
+
+#define REPEATS (20)
+#define BENCH_TGA "./tga_rle_bench.tga"
+#define BENCH_POOLED_TGA "./tga_rle_bench_pooled.tga"
+
+const char* const TEXTURES[] = { "./res/african_head_diffuse.tga", "./res/african_head_nm.tga",
+	"./res/african_head_nm_tangent.tga", "./res/african_head_spec.tga" };
+
+// The old load_rle_data: a stream read per packet header and per pixel
+bool reference_decode(std::istream& in, int bpp, std::uint8_t* dst, std::size_t npixels)
+{
+	std::size_t currentpixel = 0;
+	std::size_t currentbyte = 0;
+	std::uint8_t colorbuffer[4];
+	do {
+		std::uint8_t chunkheader = in.get();
+		if (!in.good())
+			return false;
+		if (chunkheader < 128) {
+			chunkheader++;
+			for (int i = 0; i < chunkheader; i++) {
+				in.read(reinterpret_cast<char*>(colorbuffer), bpp);
+				if (!in.good() || ++currentpixel > npixels)
+					return false;
+				for (int t = 0; t < bpp; t++)
+					dst[currentbyte++] = colorbuffer[t];
+			}
+		} else {
+			chunkheader -= 127;
+			in.read(reinterpret_cast<char*>(colorbuffer), bpp);
+			if (!in.good())
+				return false;
+			for (int i = 0; i < chunkheader; i++) {
+				if (++currentpixel > npixels)
+					return false;
+				for (int t = 0; t < bpp; t++)
+					dst[currentbyte++] = colorbuffer[t];
+			}
+		}
+	} while (currentpixel < npixels);
+	return true;
+}
+
+// The old unload_rle_data: a stream write per packet header and per packet
+void reference_encode(std::ostream& out, const std::uint8_t* data, int bpp, std::size_t npixels)
+{
+	const std::uint8_t max_chunk_length = 128;
+	std::size_t curpix = 0;
+	while (curpix < npixels) {
+		std::size_t chunkstart = curpix * bpp;
+		std::size_t curbyte = curpix * bpp;
+		std::uint8_t run_length = 1;
+		bool raw = true;
+		while (curpix + run_length < npixels && run_length < max_chunk_length) {
+			bool succ_eq = true;
+			for (int t = 0; succ_eq && t < bpp; t++)
+				succ_eq = (data[curbyte + t] == data[curbyte + t + bpp]);
+			curbyte += bpp;
+			if (1 == run_length)
+				raw = !succ_eq;
+			if (raw && succ_eq) {
+				run_length--;
+				break;
+			}
+			if (!raw && !succ_eq)
+				break;
+			run_length++;
+		}
+		curpix += run_length;
+		out.put(raw ? run_length - 1 : run_length + 127);
+		out.write(reinterpret_cast<const char*>(data + chunkstart), (raw ? run_length * bpp : bpp));
+	}
+}
+
+// Average milliseconds of REPEATS calls of fn
+template <class Fn> double time_ms(Fn&& fn)
+{
+	auto begin = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < REPEATS; i++)
+		fn();
+	auto end = std::chrono::high_resolution_clock::now();
+	return ((std::chrono::duration<double, std::milli>)(end - begin)).count() / REPEATS;
+}
+
+bool same_file(const std::string& a, const std::string& b)
+{
+	MappedFile fa(a);
+	MappedFile fb(b);
+	return fa.is_open() && fb.is_open() && fa.size() == fb.size() && std::equal(fa.data(), fa.data() + fa.size(), fb.data());
+}
+
+int main()
+{
+	ThreadPool pool;
+	for (const char* texture : TEXTURES) {
+		TGAImage image;
+		if (!image.read_tga_file(texture)) {
+			std::cerr << "Could not load " << texture << '\n';
+			return -1;
+		}
+		const int bpp = image.get_bpp();
+		const std::size_t npixels = (std::size_t)image.width() * image.height();
+		const std::uint8_t* pixels = image.get_data();
+		const double mb = npixels * bpp / (1024.0 * 1024.0);
+
+		std::ostringstream reference_stream;
+		reference_encode(reference_stream, pixels, bpp, npixels);
+		const std::string reference_packets = reference_stream.str();
+		std::vector<std::uint8_t> packets;
+		tga_rle_encode(pixels, bpp, npixels, packets);
+
+		// Both encodings through both decoders
+		std::vector<std::uint8_t> decoded(npixels * bpp);
+		bool round_trip = true;
+		const std::uint8_t* encodings[2] = { (const std::uint8_t*)reference_packets.data(), packets.data() };
+		const std::size_t sizes[2] = { reference_packets.size(), packets.size() };
+		for (int e = 0; e < 2; e++) {
+			std::fill(decoded.begin(), decoded.end(), 0);
+			round_trip = round_trip && tga_rle_decode(encodings[e], sizes[e], bpp, decoded.data(), npixels) == sizes[e]
+				&& std::equal(decoded.begin(), decoded.end(), pixels);
+			std::fill(decoded.begin(), decoded.end(), 0);
+			std::istringstream in(std::string((const char*)encodings[e], sizes[e]));
+			round_trip = round_trip && reference_decode(in, bpp, decoded.data(), npixels)
+				&& std::equal(decoded.begin(), decoded.end(), pixels);
+		}
+		// Truncated packets have to be refused, not read past
+		round_trip = round_trip && !tga_rle_decode(packets.data(), packets.size() - 1, bpp, decoded.data(), npixels);
+		if (!round_trip) {
+			std::cerr << texture << ": RLE round trip failed\n";
+			return -1;
+		}
+
+		const double reference_decode_ms = time_ms([&] {
+			std::istringstream in(reference_packets);
+			reference_decode(in, bpp, decoded.data(), npixels);
+		});
+		const double decode_ms = time_ms([&] { tga_rle_decode(packets.data(), packets.size(), bpp, decoded.data(), npixels); });
+		const double reference_encode_ms = time_ms([&] {
+			std::ostringstream out;
+			reference_encode(out, pixels, bpp, npixels);
+		});
+		const double encode_ms = time_ms([&] {
+			packets.clear();
+			tga_rle_encode(pixels, bpp, npixels, packets);
+		});
+		const double write_ms = time_ms([&] { image.write_tga_file(BENCH_TGA, false); });
+		const double pooled_write_ms = time_ms([&] { image.write_tga_file(BENCH_POOLED_TGA, pool, false); });
+		TGAImage written;
+		if (!same_file(BENCH_TGA, BENCH_POOLED_TGA) || !written.read_tga_file(BENCH_TGA)
+			|| !std::equal(pixels, pixels + npixels * bpp, written.get_data())) {
+			std::cerr << texture << ": written file does not round trip\n";
+			return -1;
+		}
+
+		std::cout << texture << ": " << mb << " MB, " << reference_packets.size() / (1024.0 * 1024.0) << " MB of packets\n";
+		std::cout << "  decode: stream " << mb / reference_decode_ms * 1000 << " MB/s, buffer "
+				  << mb / decode_ms * 1000 << " MB/s, " << reference_decode_ms / decode_ms << "x\n";
+		std::cout << "  encode: stream " << mb / reference_encode_ms * 1000 << " MB/s, buffer "
+				  << mb / encode_ms * 1000 << " MB/s, " << reference_encode_ms / encode_ms << "x\n";
+		std::cout << "  write: " << write_ms << " ms, on " << pool.size() << " threads " << pooled_write_ms << " ms\n";
+	}
+	return 0;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include "mat_vec.h"
+#include "rasterizer.h"
+
+// Clip coordinates are the vertex shader outputs before the perspective divide,
+// the viewport is already applied, so x/w and y/w are in pixels
+
+// Vertices with w below this are behind the near plane (w is the distance-like term of the projection)
+constexpr double CLIP_NEAR_W = 1e-5;
+// Pixels beyond every canvas edge where triangles are left unclipped
+// the rasterizer clamps their bounding boxes to the canvas anyway,
+// the guard band only keeps the screen coordinates small enough for exact subpixel snapping
+constexpr double GUARD_BAND = 8192;
+// Every one of the 5 clipping planes adds at most one vertex to a triangle
+constexpr int MAX_CLIP_VERTICES = 3 + 5;
+
+// Vertex of a clipped polygon
+// barycentric are its weights in the triangle that was clipped
+template <class T> struct ClipVertex {
+	vec<4, T> position;
+	vec3 barycentric;
+};
+
+// Signed distances of a vertex to the near and the guard-band planes, negative is outside
+template <class T> void clip_distances(const vec<4, T>& v, int width, int height, double (&distances)[5])
+{
+	distances[0] = v.w - CLIP_NEAR_W;
+	distances[1] = v.x + GUARD_BAND * v.w;
+	distances[2] = (width + GUARD_BAND) * v.w - v.x;
+	distances[3] = v.y + GUARD_BAND * v.w;
+	distances[4] = (height + GUARD_BAND) * v.w - v.y;
+}
+
+// Bit i is set if the vertex is outside of the i-th plane of clip_distances
+template <class T> int clip_outcode(const vec<4, T>& v, int width, int height)
+{
+	double distances[5];
+	clip_distances(v, width, height, distances);
+	int outcode = 0;
+	for (int plane = 0; plane < 5; plane++) {
+		if (!(distances[plane] >= 0))
+			outcode |= 1 << plane;
+	}
+	return outcode;
+}
+
+// Sutherland-Hodgman clipping of a triangle in clip coordinates, near plane first
+// returns the vertex count of the resulting convex polygon, less than 3 if nothing is left
+template <class T>
+int clip_triangle(const std::array<vec<4, T>, 3>& clip_coords, int width, int height,
+	ClipVertex<T> (&polygon)[MAX_CLIP_VERTICES])
+{
+	ClipVertex<T> buffer[MAX_CLIP_VERTICES];
+	ClipVertex<T>* in = polygon;
+	ClipVertex<T>* out = buffer;
+	for (int i = 0; i < 3; i++) {
+		in[i].position = clip_coords[i];
+		in[i].barycentric = vec3 {};
+		in[i].barycentric[i] = 1;
+	}
+	int count = 3;
+	for (int plane = 0; plane < 5 && count >= 3; plane++) {
+		double distances[MAX_CLIP_VERTICES];
+		for (int i = 0; i < count; i++) {
+			double all[5];
+			clip_distances(in[i].position, width, height, all);
+			distances[i] = all[plane];
+		}
+		int kept = 0;
+		for (int i = 0; i < count; i++) {
+			const int j = (i + 1) % count;
+			const bool i_inside = distances[i] >= 0;
+			const bool j_inside = distances[j] >= 0;
+			if (i_inside)
+				out[kept++] = in[i];
+			if (i_inside != j_inside) {
+				// Edge crosses the plane, t is where the distance reaches zero
+				const double t = distances[i] / (distances[i] - distances[j]);
+				out[kept].position = in[i].position + (in[j].position - in[i].position) * (T)t;
+				out[kept].barycentric = in[i].barycentric + (in[j].barycentric - in[i].barycentric) * t;
+				kept++;
+			}
+		}
+		std::swap(in, out);
+		count = kept;
+	}
+	if (in != polygon)
+		std::copy(in, in + count, polygon);
+	return count;
+}
+
+// Part of a clipped triangle, to_face[i] are the barycentrics of its i-th vertex in the clipped triangle
+template <class T> struct ClippedTriangle {
+	std::array<vec<4, T>, 3> screen_coords;
+	TriangleEdges edges;
+	mat<3, 3> to_face;
+};
+
+// Turns the barycentrics of the quad from a part of a clipped triangle into the ones of the whole triangle
+inline FragmentQuad face_quad(const FragmentQuad& quad, const mat<3, 3>& to_face)
+{
+	FragmentQuad face = quad;
+	for (int i = 0; i < 3; i++) {
+		for (int lane = 0; lane < 4; lane++) {
+			face.barycentric[i][lane] = quad.barycentric[0][lane] * to_face[0][i]
+				+ quad.barycentric[1][lane] * to_face[1][i] + quad.barycentric[2][lane] * to_face[2][i];
+		}
+	}
+	return face;
+}
+
+// Perspective divide that keeps 1/w in the w of the screen coordinates,
+// the attributes are linear in screen space once divided by w
+template <class T> vec<4, T> screen_vertex(vec<4, T> clip)
+{
+	const T rhw = T(1) / clip.w;
+	clip = clip.w_normalized();
+	clip.w = rhw;
+	return clip;
+}
+
+// Clip-space stage of the primitive assembly
+// triangles fully inside the planes are only divided by w and set up,
+// triangles crossing them are clipped and fanned into parts first
+// triangle_fn(screen_coords, edges, to_face) is called for every visible part,
+// to_face is nullptr for a triangle that was not clipped
+// perspective asks for perspective-correct barycentrics, the edges only get them if the 1/w differ,
+// so that orthographic views keep the affine interpolation
+// sample_reach is handed to setup_triangle_edges, SAMPLE_REACH for multisampled targets
+// returns visible if any part is, otherwise why the triangle was rejected
+template <class T, class Fn>
+TriangleSetup assemble_triangle(const std::array<vec<4, T>, 3>& clip_coords, int width, int height, CullMode cull,
+	bool perspective, double sample_reach, Fn&& triangle_fn)
+{
+	const int outcodes[3] = { clip_outcode(clip_coords[0], width, height), clip_outcode(clip_coords[1], width, height),
+		clip_outcode(clip_coords[2], width, height) };
+	if (outcodes[0] & outcodes[1] & outcodes[2])
+		return TriangleSetup::offscreen; // Every vertex is outside of the same plane
+
+	TriangleEdges edges;
+	if (!(outcodes[0] | outcodes[1] | outcodes[2])) {
+		std::array<vec<4, T>, 3> screen_coords = clip_coords;
+		for (auto& v : screen_coords)
+			v = screen_vertex(v);
+		const TriangleSetup setup = setup_triangle_edges(screen_coords, width, height, edges, cull, sample_reach);
+		if (setup == TriangleSetup::visible) {
+			edges.perspective = perspective && !(edges.rhw[0] == edges.rhw[1] && edges.rhw[1] == edges.rhw[2]);
+			triangle_fn(screen_coords, edges, (const mat<3, 3>*)nullptr);
+		}
+		return setup;
+	}
+
+	ClipVertex<T> polygon[MAX_CLIP_VERTICES];
+	const int count = clip_triangle(clip_coords, width, height, polygon);
+	if (count < 3)
+		return TriangleSetup::offscreen;
+	for (int i = 0; i < count; i++)
+		polygon[i].position = screen_vertex(polygon[i].position);
+
+	// The polygon is convex, so a fan around its first vertex covers it
+	TriangleSetup result = TriangleSetup::offscreen;
+	for (int i = 1; i + 1 < count; i++) {
+		const std::array<vec<4, T>, 3> screen_coords = { polygon[0].position, polygon[i].position, polygon[i + 1].position };
+		const TriangleSetup setup = setup_triangle_edges(screen_coords, width, height, edges, cull, sample_reach);
+		if (setup == TriangleSetup::visible) {
+			edges.perspective = perspective && !(edges.rhw[0] == edges.rhw[1] && edges.rhw[1] == edges.rhw[2]);
+			mat<3, 3> to_face;
+			to_face[0] = polygon[0].barycentric;
+			to_face[1] = polygon[i].barycentric;
+			to_face[2] = polygon[i + 1].barycentric;
+			triangle_fn(screen_coords, edges, &to_face);
+			result = TriangleSetup::visible;
+		} else if (result != TriangleSetup::visible && setup != TriangleSetup::offscreen) {
+			result = setup;
+		}
+	}
+	return result;
+}
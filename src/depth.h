@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "image.h"
+
+// Viewport depth of the visible range, main's get_viewport maps it to [0, DEPTH_RANGE]
+constexpr int DEPTH_RANGE = 255;
+
+// Formats of the zbuffer, Image<depth_T> can be drawn into if DepthFormat<depth_T> exists
+// the rasterizer hands over viewport z, greater is closer to the camera
+// encode(z) is the stored value of z, it has to be monotonic
+// passes(encoded, stored) is the depth test
+// clear() is the value that every depth passes
+// farther(a, b) is the one of two stored values that more depths pass
+template <class depth_T> struct DepthFormat;
+
+// Viewport z as is
+template <std::floating_point T> struct DepthFormat<T> {
+	static T encode(double z) { return (T)z; }
+	static bool passes(T z, T stored) { return z > stored; }
+	static T clear() { return std::numeric_limits<T>::lowest(); }
+	static T farther(T a, T b) { return std::min(a, b); }
+};
+
+// DEPTH_RANGE - z in a float, the closest depths land near zero where floats are densest
+struct ReversedFloatDepth {
+	float value;
+};
+
+template <> struct DepthFormat<ReversedFloatDepth> {
+	static ReversedFloatDepth encode(double z) { return { (float)(DEPTH_RANGE - z) }; }
+	static bool passes(ReversedFloatDepth z, ReversedFloatDepth stored) { return z.value < stored.value; }
+	static ReversedFloatDepth clear() { return { std::numeric_limits<float>::max() }; }
+	static ReversedFloatDepth farther(ReversedFloatDepth a, ReversedFloatDepth b) { return a.value > b.value ? a : b; }
+};
+
+// Unsigned normalized fixed point in the low "bits" bits of a 32 bit word
+// viewport z outside of [0, DEPTH_RANGE] saturates
+// reversed stores the complement, so the closest depth is 0
+template <int bits, bool reversed = false> struct FixedDepth {
+	static_assert(bits > 0 && bits <= 32);
+	std::uint32_t value;
+};
+
+template <int bits, bool reversed> struct DepthFormat<FixedDepth<bits, reversed>> {
+	using depth_T = FixedDepth<bits, reversed>;
+	static constexpr std::uint32_t max_value = bits == 32 ? 0xffffffffu : (1u << bits) - 1;
+
+	static depth_T encode(double z) {
+		// Through int64, doubles convert to it in one instruction, unlike to uint32
+		const std::uint32_t value = (std::uint32_t)(std::int64_t)(std::clamp(z / DEPTH_RANGE, 0.0, 1.0) * max_value + 0.5);
+		return { reversed ? max_value - value : value };
+	}
+	static bool passes(depth_T z, depth_T stored) {
+		return reversed ? z.value < stored.value : z.value > stored.value;
+	}
+	static depth_T clear() { return { reversed ? max_value : 0u }; }
+	static depth_T farther(depth_T a, depth_T b) {
+		return (reversed ? a.value > b.value : a.value < b.value) ? a : b;
+	}
+};
+
+// Fills the zbuffer with the clear value of its format
+// a value made of one repeated byte (0 for the fixed point formats) becomes a memset
+template <class depth_T> void clear_depth(Image<depth_T>& zbuffer)
+{
+	const depth_T clear = DepthFormat<depth_T>::clear();
+	const std::size_t count = (std::size_t)zbuffer.width * zbuffer.height;
+	unsigned char bytes[sizeof(depth_T)];
+	std::memcpy(bytes, &clear, sizeof(depth_T));
+	if (std::all_of(bytes, bytes + sizeof(depth_T), [&](unsigned char byte) { return byte == bytes[0]; })) {
+		std::memset(zbuffer.data.get(), bytes[0], count * sizeof(depth_T));
+	} else {
+		std::fill_n(zbuffer.data.get(), count, clear);
+	}
+}
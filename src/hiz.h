@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "depth.h"
+#include "image.h"
+
+// Side of the square blocks of the hierarchical depth buffer in pixels
+constexpr int HIZ_BLOCK_SIZE = 8;
+// Draws into a block before its farthest depth is read back from the zbuffer
+constexpr int HIZ_REFRESH_DRAWS = 4;
+
+// Coarse level over a zbuffer with the farthest depth of every 8x8 block
+// a triangle whose nearest depth fails the depth test against
+// the farthest depth of a block cannot change any pixel in it
+// Passing depth tests only bring the zbuffer closer, so an old farthest depth stays a safe bound,
+// blocks are refreshed from the zbuffer lazily, once they were drawn into a few times
+// they start out stale, so the zbuffer may hold anything
+// Different threads may use different blocks at the same time
+// a multisampled zbuffer (see MultisampleTarget) has "samples" depths per pixel, blocks are still 8x8 pixels
+template <class depth_T> class HierarchicalZ {
+public:
+	HierarchicalZ(Image<depth_T>& _zbuffer, int _samples = 1)
+		: blocks_x((_zbuffer.width / _samples + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE),
+		blocks_y((_zbuffer.height + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE),
+		samples(_samples),
+		zbuffer(_zbuffer),
+		block_farthest(blocks_x * blocks_y),
+		draws(blocks_x * blocks_y, HIZ_REFRESH_DRAWS)
+	{}
+
+	// Bound of the depths stored in the block, every one of them is this far or closer
+	depth_T farthest(int bx, int by) {
+		if (draws[by * blocks_x + bx] >= HIZ_REFRESH_DRAWS)
+			refresh(bx, by);
+		return block_farthest[by * blocks_x + bx];
+	}
+
+	// Call after writing into the zbuffer inside the block
+	void invalidate(int bx, int by) {
+		draws[by * blocks_x + bx]++;
+	}
+
+	const int blocks_x;
+	const int blocks_y;
+	const int samples;
+
+private:
+	void refresh(int bx, int by) {
+		const int block = by * blocks_x + bx;
+		// Rows of the block in depths, samples of a pixel are next to each other
+		const int xbegin = bx * HIZ_BLOCK_SIZE * samples;
+		const int xend = std::min<int>((bx + 1) * HIZ_BLOCK_SIZE * samples, zbuffer.width);
+		const int yend = std::min<int>((by + 1) * HIZ_BLOCK_SIZE, zbuffer.height);
+		depth_T bound = zbuffer[by * HIZ_BLOCK_SIZE * zbuffer.width + xbegin];
+		for (int y = by * HIZ_BLOCK_SIZE; y < yend; y++) {
+			for (int x = xbegin; x < xend; x++) {
+				bound = DepthFormat<depth_T>::farther(bound, zbuffer[y * zbuffer.width + x]);
+			}
+		}
+		block_farthest[block] = bound;
+		draws[block] = 0;
+	}
+
+	Image<depth_T>& zbuffer;
+	std::vector<depth_T> block_farthest;
+	// Draws into the block since its last refresh
+	std::vector<int> draws;
+};
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <concepts>
 #include <cstdint>
 #include <memory>
 #include <iostream>
@@ -17,45 +19,34 @@ public:
 		    )
 	{}
 	// Constructor from TGAImage
-	Image(TGAImage tga_image) : 
+	Image(const TGAImage& tga_image) requires std::same_as<pixel_T, std::uint32_t> :
 		width(tga_image.width()),
 		height(tga_image.height()),
 		data(
-				std::make_unique<pixel_T[]>(width*height)
+				std::make_unique_for_overwrite<pixel_T[]>(width*height)
 		    )
 	{
-		if (tga_image.get_bpp() == 3){
-			std::cout << "Creating Image from tga_image with bpp=3" << '\n';
-			for (int i = 0; i < tga_image.width()*tga_image.height(); i++){
-				// TGA uses bgr
-				// refer to the color guide in the main file
-				*((std::uint8_t*)data.get() + 4*i + 3) = 0xff;
-				memcpy(((std::uint8_t*)data.get()) + 4*i + 0, ((std::uint8_t*)tga_image.get_data()) + 3*i + 2, sizeof(std::uint8_t));
-				memcpy(((std::uint8_t*)data.get()) + 4*i + 1, ((std::uint8_t*)tga_image.get_data()) + 3*i + 1, sizeof(std::uint8_t));
-				memcpy(((std::uint8_t*)data.get()) + 4*i + 2, ((std::uint8_t*)tga_image.get_data()) + 3*i + 0, sizeof(std::uint8_t));
-			}
-		} else if (tga_image.get_bpp() == 4){
-			std::cout << "Creating Image from tga_image with bpp=4" << '\n';
-			for (int i = 0; i < tga_image.width()*tga_image.height(); i++){
-				// TGA uses bgra
-				// refer to the color guide in the main file
-				memcpy(((std::uint8_t*)data.get()) + 4*i + 3, ((std::uint8_t*)tga_image.get_data()) + 4*i + 3, sizeof(std::uint8_t));
-				memcpy(((std::uint8_t*)data.get()) + 4*i + 0, ((std::uint8_t*)tga_image.get_data()) + 4*i + 2, sizeof(std::uint8_t));
-				memcpy(((std::uint8_t*)data.get()) + 4*i + 1, ((std::uint8_t*)tga_image.get_data()) + 4*i + 1, sizeof(std::uint8_t));
-				memcpy(((std::uint8_t*)data.get()) + 4*i + 2, ((std::uint8_t*)tga_image.get_data()) + 4*i + 0, sizeof(std::uint8_t));
-			}
-		} else if (tga_image.get_bpp() == 1) {
-			std::cout << "Creating Image from tga_image with bpp=1" << '\n';
-			for (int i = 0; i < tga_image.width()*tga_image.height(); i++){
-				// TGA uses 1 byte grayscale here (0-255)
-				// I will just store that in the red section of std::uint32_t
-				data.get()[i] = *(tga_image.get_data() + i);
-				//memcpy((std::uint8_t*)data.get() + 4*i, ((std::uint8_t*)tga_image.get_data()) + i, sizeof(std::uint8_t));
-			}
+		const int bpp = tga_image.get_bpp();
+		if (bpp == TGAImage::GRAYSCALE || bpp == TGAImage::RGB || bpp == TGAImage::RGBA){
+			std::cout << "Creating Image from tga_image with bpp=" << bpp << '\n';
+			// refer to the color guide in the main file, grayscale goes into the red byte
+			tga_to_rgba(tga_image.get_data(), bpp, (std::uint32_t*)data.get(), width*height);
 		} else {
-			std::cerr << "Weird bpp encountered while initializing Image<std::uint32_t>, bpp = " << tga_image.get_bpp() << '\n';
+			std::cerr << "Weird bpp encountered while initializing Image<std::uint32_t>, bpp = " << bpp << '\n';
+			std::fill_n(data.get(), width*height, pixel_T());
+		}
+	}
+	// Constructor from a TGA file, decoded right into data without a TGAImage in between
+	explicit Image(const TGAFile& tga_file) requires std::same_as<pixel_T, std::uint32_t> :
+		width(tga_file.width()),
+		height(tga_file.height()),
+		data(
+				std::make_unique_for_overwrite<pixel_T[]>(width*height)
+		    )
+	{
+		if (!tga_file.decode(data.get())) {
+			std::fill_n(data.get(), width*height, pixel_T());
 		}
-
 	}
 
 	// Member functions
@@ -0,0 +1,467 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+
+#include "tgaimage.h"
+
+// The swizzle kernel is built with a per-function target attribute and picked at runtime
+#if defined(__GNUC__) && defined(__SSE2__)
+#define IMAGE_WRITER_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef IMAGE_WRITER_SIMD
+// 4 pixels per shuffle, every 16 byte store keeps its first 12 bytes
+// returns how many pixels were converted, the stores stop before writing past the destination
+[[gnu::target("ssse3")]] static std::size_t rgba_to_rgb_ssse3(const std::uint32_t* src, std::uint8_t* dst, std::size_t count)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	std::size_t i = 0;
+	for (; i + 6 <= count; i += 4) {
+		const __m128i rgba = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + 3 * i), _mm_shuffle_epi8(rgba, shuffle));
+	}
+	return i;
+}
+
+static bool cpu_has_ssse3()
+{
+	static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+	return has_ssse3;
+}
+#endif
+
+void rgba_to_rgb(const std::uint32_t* src, std::uint8_t* dst, std::size_t count)
+{
+	std::size_t i = 0;
+#ifdef IMAGE_WRITER_SIMD
+	if (cpu_has_ssse3())
+		i = rgba_to_rgb_ssse3(src, dst, count);
+#endif
+	for (; i < count; i++) {
+		dst[3 * i + 0] = src[i] >> (8 * 0);
+		dst[3 * i + 1] = src[i] >> (8 * 1);
+		dst[3 * i + 2] = src[i] >> (8 * 2);
+	}
+}
+
+static std::string ppm_header(int width, int height)
+{
+	return "P6\n" + std::to_string(width) + " " + std::to_string(height) + " 255\n";
+}
+
+int write_ppm(const std::string& filepath, const Image<std::uint32_t>& canvas)
+{
+	const std::string header = ppm_header(canvas.width, canvas.height);
+	std::vector<std::uint8_t> bytes(header.size() + (std::size_t)canvas.width * canvas.height * 3);
+	std::memcpy(bytes.data(), header.data(), header.size());
+	rgba_to_rgb(canvas.data.get(), bytes.data() + header.size(), (std::size_t)canvas.width * canvas.height);
+	std::ofstream file(filepath, std::ios::out | std::ios::binary);
+	file.write((const char*)bytes.data(), bytes.size());
+	if (!file.good()) {
+		std::cerr << "Error with file " << filepath << " in write_ppm\n";
+		return -1;
+	}
+	return 0;
+}
+
+// PNG
+
+static void put_u32_be(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back(value >> shift);
+}
+
+// Slicing by 8, table[k][n] is the crc of byte n followed by k zero bytes
+static std::uint32_t crc32(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+{
+	static const std::array<std::array<std::uint32_t, 256>, 8> table = [] {
+		std::array<std::array<std::uint32_t, 256>, 8> table {};
+		for (std::uint32_t n = 0; n < 256; n++) {
+			std::uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[0][n] = c;
+		}
+		for (int k = 1; k < 8; k++) {
+			for (int n = 0; n < 256; n++)
+				table[k][n] = table[0][table[k - 1][n] & 0xff] ^ (table[k - 1][n] >> 8);
+		}
+		return table;
+	}();
+	crc = ~crc;
+	for (; size >= 8; size -= 8, data += 8) {
+		const std::uint32_t low = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | (std::uint32_t)data[3] << 24);
+		crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24]
+			^ table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+	}
+	for (; size; size--, data++)
+		crc = table[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static std::uint32_t adler32(std::uint32_t adler, const std::uint8_t* data, std::size_t size)
+{
+	std::uint32_t a = adler & 0xffff;
+	std::uint32_t b = adler >> 16;
+	while (size) {
+		// The most bytes before b can overflow
+		const std::size_t n = std::min<std::size_t>(size, 5552);
+		for (std::size_t i = 0; i < n; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += n;
+		size -= n;
+	}
+	return b << 16 | a;
+}
+
+// Appends a chunk of the given type, the data is appended in between by fill
+template <class Fn> static void png_chunk(std::vector<std::uint8_t>& out, const char (&type)[5], Fn&& fill)
+{
+	const std::size_t start = out.size();
+	put_u32_be(out, 0);
+	out.insert(out.end(), type, type + 4);
+	fill(out);
+	const std::size_t length = out.size() - start - 8;
+	for (int i = 0; i < 4; i++)
+		out[start + i] = length >> (24 - 8 * i);
+	put_u32_be(out, crc32(0, out.data() + start + 4, length + 4));
+}
+
+// Signature and IHDR of 8 bit rgb pixels
+static void png_header(std::vector<std::uint8_t>& out, int width, int height)
+{
+	constexpr std::uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	out.insert(out.end(), signature, signature + 8);
+	png_chunk(out, "IHDR", [&](std::vector<std::uint8_t>& data) {
+		put_u32_be(data, width);
+		put_u32_be(data, height);
+		data.insert(data.end(), { 8, 2, 0, 0, 0 }); // Bit depth, truecolor, deflate, filter method 0, no interlace
+	});
+}
+
+struct HuffmanCode {
+	std::uint16_t bits; // Reversed, deflate sends the codes starting with their most significant bit
+	std::uint8_t length;
+};
+
+static std::uint16_t reverse_bits(std::uint16_t code, int length)
+{
+	std::uint16_t reversed = 0;
+	for (int i = 0; i < length; i++)
+		reversed |= ((code >> i) & 1) << (length - 1 - i);
+	return reversed;
+}
+
+// Fixed literal/length codes of deflate
+static const std::array<HuffmanCode, 288>& fixed_literal_codes()
+{
+	static const std::array<HuffmanCode, 288> codes = [] {
+		std::array<HuffmanCode, 288> codes {};
+		for (int symbol = 0; symbol < 288; symbol++) {
+			if (symbol < 144)
+				codes[symbol] = { reverse_bits(0x30 + symbol, 8), 8 };
+			else if (symbol < 256)
+				codes[symbol] = { reverse_bits(0x190 + symbol - 144, 9), 9 };
+			else if (symbol < 280)
+				codes[symbol] = { reverse_bits(symbol - 256, 7), 7 };
+			else
+				codes[symbol] = { reverse_bits(0xc0 + symbol - 280, 8), 8 };
+		}
+		return codes;
+	}();
+	return codes;
+}
+
+constexpr int DEFLATE_MIN_MATCH = 3;
+constexpr int DEFLATE_MAX_MATCH = 258;
+constexpr int DEFLATE_WINDOW = 32768;
+constexpr int DEFLATE_HASH_BITS = 15;
+constexpr std::uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+	99, 115, 131, 163, 195, 227, 258 };
+constexpr std::uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5,
+	5, 0 };
+constexpr std::uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr std::uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11,
+	11, 12, 12, 13, 13 };
+
+// Length code (0 for symbol 257) of every match length
+static const std::array<std::uint8_t, DEFLATE_MAX_MATCH + 1>& length_codes()
+{
+	static const std::array<std::uint8_t, DEFLATE_MAX_MATCH + 1> codes = [] {
+		std::array<std::uint8_t, DEFLATE_MAX_MATCH + 1> codes {};
+		// 258 has a code of its own, the last one overwrites it
+		for (int code = 0; code < 29; code++) {
+			for (int length = LENGTH_BASE[code]; length < LENGTH_BASE[code] + (1 << LENGTH_EXTRA[code]) && length <= DEFLATE_MAX_MATCH; length++)
+				codes[length] = code;
+		}
+		return codes;
+	}();
+	return codes;
+}
+
+// zlib stream of the IDAT chunks, the filtered rows go through it band by band
+// every band is a non-final deflate block of its own and the bits that do not fill a byte are kept for the next one
+struct PngStream {
+	explicit PngStream(PngCompression compression) : compression(compression) {}
+
+	// Appends an IDAT chunk with rows of packed rgb
+	void write_rows(const std::uint8_t* rgb, int width, int rows, std::vector<std::uint8_t>& out)
+	{
+		const std::size_t stride = (std::size_t)width * 3;
+		filtered.resize(rows * (stride + 1));
+		for (int y = 0; y < rows; y++) {
+			const std::uint8_t* row = rgb + y * stride;
+			std::uint8_t* dst = filtered.data() + y * (stride + 1);
+			if (compression == PngCompression::store) {
+				dst[0] = 0; // None
+				std::memcpy(dst + 1, row, stride);
+			} else {
+				// Sub, flat areas become runs of zeros
+				dst[0] = 1;
+				std::memcpy(dst + 1, row, std::min<std::size_t>(3, stride));
+				for (std::size_t x = 3; x < stride; x++)
+					dst[1 + x] = row[x] - row[x - 3];
+			}
+		}
+		adler = adler32(adler, filtered.data(), filtered.size());
+		png_chunk(out, "IDAT", [&](std::vector<std::uint8_t>& data) {
+			if (compression == PngCompression::store)
+				store(data);
+			else
+				deflate(data);
+		});
+	}
+
+	// Appends the last IDAT chunk, with the final block and the checksum, and IEND
+	void finish(std::vector<std::uint8_t>& out)
+	{
+		png_chunk(out, "IDAT", [&](std::vector<std::uint8_t>& data) {
+			// Empty final block with the fixed codes
+			put(1, 1);
+			put(1, 2);
+			put(fixed_literal_codes()[256].bits, fixed_literal_codes()[256].length);
+			align(data);
+			put_u32_be(data, adler);
+		});
+		png_chunk(out, "IEND", [](std::vector<std::uint8_t>&) {});
+	}
+
+private:
+	void put(std::uint32_t value, int length)
+	{
+		bits |= (std::uint64_t)value << nbits;
+		nbits += length;
+	}
+
+	// Moves the full bytes of the bit buffer to out
+	void flush(std::vector<std::uint8_t>& out)
+	{
+		for (; nbits >= 8; nbits -= 8, bits >>= 8)
+			out.push_back(bits);
+	}
+
+	// Pads the bit buffer to a byte boundary and empties it
+	void align(std::vector<std::uint8_t>& out)
+	{
+		nbits = (nbits + 7) & ~7;
+		flush(out);
+	}
+
+	void store(std::vector<std::uint8_t>& out)
+	{
+		for (std::size_t begin = 0; begin < filtered.size(); begin += 65535) {
+			const std::uint16_t size = std::min<std::size_t>(filtered.size() - begin, 65535);
+			put(0, 1);
+			put(0, 2);
+			align(out);
+			out.insert(out.end(), { (std::uint8_t)size, (std::uint8_t)(size >> 8), (std::uint8_t)~size, (std::uint8_t)(~size >> 8) });
+			out.insert(out.end(), filtered.begin() + begin, filtered.begin() + begin + size);
+		}
+	}
+
+	// A block with the fixed codes, matches are found with a single probe of a hash of the next 4 bytes
+	// and never reach back into the bands before
+	void deflate(std::vector<std::uint8_t>& out)
+	{
+		const std::array<HuffmanCode, 288>& literal_codes = fixed_literal_codes();
+		const std::array<std::uint8_t, DEFLATE_MAX_MATCH + 1>& lengths = length_codes();
+		const std::uint8_t* data = filtered.data();
+		const std::size_t size = filtered.size();
+		head.assign(1 << DEFLATE_HASH_BITS, -1);
+		put(0, 1);
+		put(1, 2);
+		std::size_t i = 0;
+		while (i < size) {
+			// 32 bits always fit next to the bits left by the flush
+			if (nbits >= 32) {
+				for (int k = 0; k < 4; k++)
+					out.push_back(bits >> (8 * k));
+				bits >>= 32;
+				nbits -= 32;
+			}
+			std::size_t length = 0;
+			std::size_t distance = 0;
+			if (i + 4 <= size) {
+				std::uint32_t next;
+				std::memcpy(&next, data + i, 4);
+				const std::uint32_t hash = (next * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+				const std::int32_t candidate = head[hash];
+				head[hash] = i;
+				if (candidate >= 0 && i - candidate <= DEFLATE_WINDOW && std::memcmp(data + candidate, data + i, 4) == 0) {
+					const std::size_t limit = std::min<std::size_t>(DEFLATE_MAX_MATCH, size - i);
+					length = 4;
+					while (length < limit && data[candidate + length] == data[i + length])
+						length++;
+					distance = i - candidate;
+				}
+			}
+			if (length < DEFLATE_MIN_MATCH) {
+				const HuffmanCode& code = literal_codes[data[i]];
+				put(code.bits, code.length);
+				i++;
+				continue;
+			}
+			const int length_code = lengths[length];
+			const HuffmanCode& code = literal_codes[257 + length_code];
+			put(code.bits | (length - LENGTH_BASE[length_code]) << code.length, code.length + LENGTH_EXTRA[length_code]);
+			const int distance_code = std::upper_bound(DISTANCE_BASE, DISTANCE_BASE + 30, distance) - DISTANCE_BASE - 1;
+			put(reverse_bits(distance_code, 5) | (distance - DISTANCE_BASE[distance_code]) << 5, 5 + DISTANCE_EXTRA[distance_code]);
+			i += length;
+		}
+		put(literal_codes[256].bits, literal_codes[256].length);
+		flush(out);
+	}
+
+	const PngCompression compression;
+	// The zlib header (deflate with a 32K window, no dictionary) goes out first
+	std::uint64_t bits = 0x0178;
+	int nbits = 16;
+	std::uint32_t adler = 1;
+	std::vector<std::uint8_t> filtered;
+	std::vector<std::int32_t> head; // Last position of every hash in filtered
+};
+
+int write_png(const std::string& filepath, const Image<std::uint32_t>& canvas, PngCompression compression)
+{
+	std::vector<std::uint8_t> rgb((std::size_t)canvas.width * canvas.height * 3);
+	rgba_to_rgb(canvas.data.get(), rgb.data(), (std::size_t)canvas.width * canvas.height);
+	std::vector<std::uint8_t> bytes;
+	png_header(bytes, canvas.width, canvas.height);
+	PngStream png(compression);
+	png.write_rows(rgb.data(), canvas.width, canvas.height, bytes);
+	png.finish(bytes);
+	std::ofstream file(filepath, std::ios::out | std::ios::binary);
+	file.write((const char*)bytes.data(), bytes.size());
+	if (!file.good()) {
+		std::cerr << "Error with file " << filepath << " in write_png\n";
+		return -1;
+	}
+	return 0;
+}
+
+int write_tga(const std::string& filepath, const Image<std::uint32_t>& canvas, bool rle, ThreadPool* pool)
+{
+	const int width = canvas.width;
+	// Swapping red and blue is its own inverse, the decoder swizzle turns rgba into bgra
+	const TGAPixelSource source { width, (int)canvas.height, TGAImage::RGBA,
+		[&](int y, int count, std::uint8_t* scratch) {
+			tga_to_rgba((const std::uint8_t*)(canvas.data.get() + (std::size_t)y * width), TGAImage::RGBA,
+				(std::uint32_t*)scratch, (std::size_t)count * width);
+			return (const std::uint8_t*)scratch;
+		} };
+	return write_tga_file(filepath, source, false, rle, pool) ? 0 : -1;
+}
+
+ImageRowStream::ImageRowStream(const std::string& filepath, int width, int height, ImageFormat format,
+	PngCompression compression)
+	: filepath(filepath)
+	, width(width)
+	, height(height)
+	, format(format)
+	, file(filepath, std::ios::out | std::ios::binary)
+{
+	if (!file.is_open()) {
+		std::cerr << "Error with file " << filepath << " in ImageRowStream\n";
+		return;
+	}
+	if (format == ImageFormat::ppm) {
+		file << ppm_header(width, height);
+	} else {
+		png = std::make_unique<PngStream>(compression);
+		std::vector<std::uint8_t> header;
+		png_header(header, width, height);
+		file.write((const char*)header.data(), header.size());
+	}
+}
+
+ImageRowStream::~ImageRowStream()
+{
+	close();
+}
+
+void ImageRowStream::write_rows(const Image<std::uint32_t>& canvas, int y_begin, int y_end)
+{
+	std::vector<std::uint8_t> rgb((std::size_t)(y_end - y_begin) * width * 3);
+	rgba_to_rgb(canvas.data.get() + (std::size_t)y_begin * width, rgb.data(), (std::size_t)(y_end - y_begin) * width);
+	std::lock_guard lock(mutex);
+	if (closed || !file.is_open())
+		return;
+	if (y_begin != next_row) {
+		pending.emplace(y_begin, std::move(rgb));
+		return;
+	}
+	append(rgb, y_end - y_begin);
+	// The rows that were waiting for these
+	while (!pending.empty() && pending.begin()->first == next_row) {
+		append(pending.begin()->second, pending.begin()->second.size() / ((std::size_t)width * 3));
+		pending.erase(pending.begin());
+	}
+}
+
+void ImageRowStream::append(const std::vector<std::uint8_t>& rgb, int rows)
+{
+	if (format == ImageFormat::ppm) {
+		file.write((const char*)rgb.data(), rgb.size());
+	} else {
+		std::vector<std::uint8_t> chunk;
+		png->write_rows(rgb.data(), width, rows, chunk);
+		file.write((const char*)chunk.data(), chunk.size());
+	}
+	next_row += rows;
+}
+
+int ImageRowStream::close()
+{
+	std::lock_guard lock(mutex);
+	if (closed)
+		return 0;
+	closed = true;
+	if (!file.is_open())
+		return -1;
+	int ret = 0;
+	if (next_row != height) {
+		std::cerr << "Rows " << next_row << " to " << height << " never made it into " << filepath << '\n';
+		ret = -1;
+	}
+	if (png) {
+		std::vector<std::uint8_t> end;
+		png->finish(end);
+		file.write((const char*)end.data(), end.size());
+	}
+	file.close();
+	if (!file.good()) {
+		std::cerr << "Error with file " << filepath << " in ImageRowStream\n";
+		ret = -1;
+	}
+	return ret;
+}
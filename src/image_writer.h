@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+class ThreadPool;
+
+// Converts count pixels of Image<std::uint32_t> (red in the low byte) into packed rgb, 3 bytes per pixel
+// 4 pixels per shuffle with SSSE3 if the CPU has it
+void rgba_to_rgb(const std::uint32_t* src, std::uint8_t* dst, std::size_t count);
+
+// store writes the PNG pixels as they are, fast deflates them with the fixed Huffman codes
+// and a single probe for earlier matches, after subtracting the pixel to the left
+enum class PngCompression { store, fast };
+
+// Writers of a whole canvas, the file is put together in memory and written at once
+// return 0, or -1 after a message on std::cerr
+int write_ppm(const std::string& filepath, const Image<std::uint32_t>& canvas);
+int write_png(const std::string& filepath, const Image<std::uint32_t>& canvas,
+	PngCompression compression = PngCompression::fast);
+// Goes through the writer of "tgaimage.h" with a top-left origin,
+// the rows are swizzled into bgra range by range as they are encoded, the canvas is never copied whole
+int write_tga(const std::string& filepath, const Image<std::uint32_t>& canvas, bool rle = true, ThreadPool* pool = nullptr);
+
+enum class ImageFormat { ppm, png };
+
+struct PngStream;
+
+// File that the rows of a canvas are written into while the rest of it is still being drawn,
+// see DrawOptions::rows_done
+// write_rows may be called from any thread with the rows in any order, each row once,
+// the rows are converted by the calling thread and written as soon as all the rows above them were
+class ImageRowStream {
+public:
+	ImageRowStream(const std::string& filepath, int width, int height, ImageFormat format = ImageFormat::ppm,
+		PngCompression compression = PngCompression::fast);
+	~ImageRowStream();
+	ImageRowStream(const ImageRowStream&) = delete;
+	ImageRowStream& operator=(const ImageRowStream&) = delete;
+
+	bool is_open() const { return file.is_open(); }
+	// Rows [y_begin, y_end) of canvas, which has the width of the stream
+	void write_rows(const Image<std::uint32_t>& canvas, int y_begin, int y_end);
+	// Finishes the file, returns 0 if every row made it into it, -1 after a message on std::cerr
+	int close();
+
+private:
+	// Writes the rgb rows starting at next_row, the mutex is held
+	void append(const std::vector<std::uint8_t>& rgb, int rows);
+
+	const std::string filepath;
+	const int width;
+	const int height;
+	const ImageFormat format;
+	std::ofstream file;
+	std::unique_ptr<PngStream> png;
+	std::mutex mutex;
+	int next_row = 0;
+	// Converted rows that arrived before the ones above them, by their first row
+	std::map<int, std::vector<std::uint8_t>> pending;
+	bool closed = false;
+};
@@ -13,9 +13,15 @@
 #include "./parser.h"
 #include "./renderer.h"
 #include "./model.h"
+#include "./batch_renderer.h"
 #include "./image.h"
+#include "./image_writer.h"
 #include "./posterization.h"
+#include "./shaders.h"
+#include "./texture.h"
 #include "./tgaimage.h"
+#include "./thread_pool.h"
+#include "./tiled_renderer.h"
 
 // Color guide:
 // 0xAABBGGRR in hex notation within a uint32
@@ -23,310 +29,60 @@
 
 #define WIDTH  (1000)
 #define HEIGHT (1000)
+// Amount of rendering threads, 0 uses every core
+#define THREADS (0)
+// Shade every visible pixel once after a visibility pass instead of shading every depth test pass
+#define DEFERRED (true)
+// Perspective-correct varyings, false interpolates them linearly on the screen
+#define PERSPECTIVE (true)
+// Samples per pixel of the anti-aliasing: 1, 2, 4 or 8
+#define SAMPLES (4)
+// Reorder the faces of the model for vertex locality after loading it
+#define OPTIMIZE_FACE_ORDER (true)
+// Filtering of the texture maps: nearest, bilinear or trilinear (mipmapped), see "texture.h"
+#define TEXTURE_FILTER (TextureFilter::trilinear)
+// Format of the output file, ppm or png, its rows are written as the rows of tiles finish
+#define OUTPUT_FORMAT (ImageFormat::ppm)
+// Views of an orbit around the model rendered into view_0000.ppm and on by render_batch,
+// several at once, 0 renders the single view into output.ppm
+#define BATCH_VIEWS (0)
 #define FOREGROUND_COLOR 0xFFFFFFFF
 #define BACKGROUND_COLOR 0xFF000000
 
-// File scope declarations
-Model mdl;
-vec3 light_dir;
-mat<4,4> Viewport;
-mat<4,4> Projection;
-mat<4,4> ModelView;
+// Scalar type of the pipeline (model, matrices and shaders)
+// float halves the memory traffic of the vertex data
+typedef double scalar_T;
 
-struct DepthShader : public ShaderClass<std::uint32_t> {
-	mat<3,3> varying_tri;
-
-	DepthShader() : varying_tri() {}
-
-	vec<4> vertex(int iface, int nthvert) override {
-		vec<4> gl_Vertex = embed<4>(mdl.verts[mdl.face_vrtx[iface + nthvert]]);
-		varying_tri[nthvert] = proj<3>((Projection*ModelView*gl_Vertex).w_normalized());
-		//gl_Vertex = Viewport*Projection*ModelView*gl_Vertex;
-
-		return (Viewport*Projection*ModelView*gl_Vertex).w_normalized();
-	}
-
-	bool fragment(vec3 barycentric, std::uint32_t& color) override {
-	}
-};
-
-struct FlatShader : public ShaderClass<std::uint32_t>{
-	mat<3,3> varying_pos;
-	mat<3,3> varying_nrm;
-	mat<3,2> varying_uv;
-
-	vec<4> vertex(int iface, int nthvert) override {
-		varying_nrm[nthvert] = mdl.normals[mdl.face_norm[iface + nthvert]];
-		varying_uv[nthvert] = proj<2>(mdl.tex_coords[mdl.face_tex[iface + nthvert]]);
-
-		vec4 gl_Vertex = embed<4>(mdl.verts[mdl.face_vrtx[iface + nthvert]]);
-		varying_pos[nthvert] = proj<3>((Projection*ModelView*gl_Vertex).w_normalized());
-
-		return (Viewport*Projection*ModelView*gl_Vertex).w_normalized();
-	}
-
-	bool fragment(vec3 barycentric, std::uint32_t& color) override {
-		std::uint8_t* color_channel = (std::uint8_t*)&color;
-		color = 0xa0a0a0;
-		return false;
-	}
-};
-
-struct PosterizationShader : public ShaderClass<std::uint32_t>{
-	// ambient is not used
-	int uniform_ambient;
-	// floats are the upper bounds for each posterization color
-	std::vector<std::pair<std::uint32_t, float>> uniform_colors_with_bounds{{0xffa0a0a0, 1.0}};
-	mat<3,3> varying_pos;
-	mat<3,3> varying_nrm;
-	mat<3,2> varying_uv;
-
-	mat<4,4> uniform_M; // Projection*ModelView
-	mat<4,4> uniform_M_IT; // Projection*ModelView invert_transpose()
-
-	vec<4> vertex(int iface, int nthvert) override {
-		varying_nrm[nthvert] = mdl.normals[mdl.face_norm[iface + nthvert]];
-		varying_uv[nthvert] = proj<2>(mdl.tex_coords[mdl.face_tex[iface + nthvert]]);
-
-		vec4 gl_Vertex = embed<4>(mdl.verts[mdl.face_vrtx[iface + nthvert]]);
-
-		varying_pos[nthvert] = proj<3>((Projection*ModelView*gl_Vertex).w_normalized());
-
-		return (Viewport*Projection*ModelView*gl_Vertex).w_normalized();
-	}
-
-	bool fragment(vec3 barycentric, std::uint32_t& color) override {
-		constexpr std::uint32_t default_color = 0xa0a0a0;
-
-		vec3 surface_normal = (varying_nrm.transpose() * barycentric).normalized();
-
-		vec3 n = proj<3>(uniform_M_IT*embed<4>(surface_normal)).normalized(); // transformed normal
-		vec3 l = proj<3>(uniform_M   *embed<4>(light_dir)).normalized(); // transformed light_dir
-
-		float diffuse = std::max(0.0, n*l);
-
-		// I could write binary search here, but linear should do as well
-		// since number of posterization colors shouldn't be that high
-
-		for (const auto& color_with_upper_bound : uniform_colors_with_bounds) {
-			if (diffuse < color_with_upper_bound.second) {
-				color = color_with_upper_bound.first;
-				return false;
-			}
-		}
-		color = 0xffc0c0c0;
-		return false;
-	}
-};
-
-struct PhongShader : public ShaderClass<std::uint32_t>{
-	int uniform_ambient;
-	mat<3,3> varying_pos;
-	mat<3,3> varying_nrm;
-	mat<3,2> varying_uv;
-
-	mat<4,4> uniform_M; // Projection*ModelView
-	mat<4,4> uniform_M_IT; // Projection*ModelView invert_transpose()
-
-	vec<4> vertex(int iface, int nthvert) override {
-		varying_nrm[nthvert] = mdl.normals[mdl.face_norm[iface + nthvert]];
-		varying_uv[nthvert] = proj<2>(mdl.tex_coords[mdl.face_tex[iface + nthvert]]);
-
-		vec4 gl_Vertex = embed<4>(mdl.verts[mdl.face_vrtx[iface + nthvert]]);
-
-		varying_pos[nthvert] = proj<3>((Projection*ModelView*gl_Vertex).w_normalized());
-
-		return (Viewport*Projection*ModelView*gl_Vertex).w_normalized();
-	}
-
-	bool fragment(vec3 barycentric, std::uint32_t& color) override {
-		constexpr std::uint32_t default_color = 0xa0a0a0;
-		constexpr std::uint8_t  default_channel = 0xe0;
-
-		vec3 surface_normal = (varying_nrm.transpose() * barycentric).normalized();
-
-		vec3 n = proj<3>(uniform_M_IT*embed<4>(surface_normal)).normalized(); // transformed normal
-		vec3 l = proj<3>(uniform_M   *embed<4>(light_dir)).normalized(); // transformed light_dir
-
-		float diffuse = std::max(0.0, n*l);
-
-		std::uint8_t* color_channel = (std::uint8_t*)&color;
-		for (int i = 0; i < 3; i++) {
-			color_channel[i] = uniform_ambient + default_channel*(1.0*diffuse);
-		}
-		return false;
-	}
-};
-
-struct CarcassShader : public ShaderClass<std::uint32_t>{
-	// ambient is not used
-	int uniform_ambient;
-
-	mat<3,3> varying_pos;
-	mat<3,3> varying_nrm;
-	mat<3,2> varying_uv;
-
-	mat<4,4> uniform_M; // Projection*ModelView
-	mat<4,4> uniform_M_IT; // Projection*ModelView invert_transpose()
-
-	vec<4> vertex(int iface, int nthvert) override {
-		varying_nrm[nthvert] = mdl.normals[mdl.face_norm[iface + nthvert]];
-		varying_uv[nthvert] = proj<2>(mdl.tex_coords[mdl.face_tex[iface + nthvert]]);
-
-		vec4 gl_Vertex = embed<4>(mdl.verts[mdl.face_vrtx[iface + nthvert]]);
-
-		varying_pos[nthvert] = proj<3>((Projection*ModelView*gl_Vertex).w_normalized());
-
-		return (Viewport*Projection*ModelView*gl_Vertex).w_normalized();
-	}
-
-	bool fragment(vec3 barycentric, std::uint32_t& color) override {
-		constexpr std::uint32_t default_color = 0xa0a0a0;
-		constexpr double threshhold = 0.005;
-
-		if (barycentric.x <= threshhold || barycentric.y <= threshhold || barycentric.z <= threshhold) { 
-			vec3 surface_normal = (varying_nrm.transpose() * barycentric).normalized();
-			vec3 n = proj<3>(uniform_M_IT*embed<4>(surface_normal)).normalized(); // transformed normal
-			vec3 l = proj<3>(uniform_M   *embed<4>(light_dir)).normalized(); // transformed light_dir
-			float diffuse = std::max(0.0, n*l);
-			color = 0xffc0c0c0;
-			return false;
-		} else {
-			return true;
-		}
-	}
-};
-
-struct CutoffShader : public ShaderClass<std::uint32_t>{
-	// ambient is not used
-	int uniform_ambient;
-
-	mat<3,3> varying_obj_coords;
-	mat<3,3> varying_pos;
-	mat<3,3> varying_nrm;
-	mat<3,2> varying_uv;
-
-	mat<4,4> uniform_M; // Projection*ModelView
-	mat<4,4> uniform_M_IT; // Projection*ModelView invert_transpose()
-
-	vec<4> vertex(int iface, int nthvert) override {
-		varying_nrm[nthvert] = mdl.normals[mdl.face_norm[iface + nthvert]];
-		varying_uv[nthvert] = proj<2>(mdl.tex_coords[mdl.face_tex[iface + nthvert]]);
-
-		vec4 gl_Vertex = embed<4>(mdl.verts[mdl.face_vrtx[iface + nthvert]]);
-
-		varying_obj_coords[nthvert] = proj<3>((gl_Vertex).w_normalized());
-		varying_pos[nthvert] = proj<3>((Projection*ModelView*gl_Vertex).w_normalized());
-
-		return (Viewport*Projection*ModelView*gl_Vertex).w_normalized();
-	}
-
-	bool fragment(vec3 barycentric, std::uint32_t& color) override {
-		constexpr std::uint32_t default_color  = 0xa0a0a0;
-		constexpr std::uint8_t default_channel = 0xe0;
-
-		vec3 pos = (varying_obj_coords.transpose() * barycentric);
-		vec3 surface_normal = (varying_nrm.transpose() * barycentric).normalized();
-
-		//if (0 <= pos.y) {
-		//	return true;
-		//}
-
-		vec3 n = proj<3>(uniform_M_IT*embed<4>(surface_normal)).normalized(); // transformed normal
-		vec3 l = proj<3>(uniform_M   *embed<4>(light_dir)).normalized(); // transformed light_dir
-
-		float diffuse = std::max(0.0, n*l);
-
-		std::uint8_t* color_channel = (std::uint8_t*)&color;
-		for (int i = 0; i < 3; i++) {
-			color_channel[i] = uniform_ambient + default_channel*diffuse;
-		}
-		return false;
-	}
-};
-
-struct TextureTangentNormalShader : public ShaderClass<std::uint32_t>{
-	int uniform_ambient;
-	mat<3,3> varying_nrm;
-	mat<3,2> varying_uv;
-	/*
-	[u0, v0],
-	[u1, v1],
-	[u2, v2],
-	*/
-	mat<4,4> uniform_M; // Projection*ModelView
-	mat<4,4> uniform_M_IT; // Projection*ModelView invert_transpose()
-	mat<3,3> ndc_tri; // Vertices in normalized device coords, each vector is separate row
-
-	vec<4> vertex(int iface, int nthvert) override {
-		varying_nrm[nthvert] = mdl.normals[mdl.face_norm[iface + nthvert]];
-		varying_uv[nthvert] = proj<2>(mdl.tex_coords[mdl.face_tex[iface + nthvert]]);
-
-		vec4 gl_Vertex = embed<4>(mdl.verts[mdl.face_vrtx[iface + nthvert]]);
-		ndc_tri[nthvert] = proj<3>((Projection*ModelView*gl_Vertex).w_normalized());
-
-		return (Viewport*Projection*ModelView*gl_Vertex).w_normalized();
-	}
-
-	bool fragment(vec3 barycentric, std::uint32_t& color) override {
-		vec2 uv = (varying_uv.transpose()) * barycentric;
-		vec3 surface_normal = (varying_nrm.transpose() * barycentric).normalized();
-		
-		mat<3,3> A;
-		A[0] = ndc_tri[1] - ndc_tri[0];
-		A[1] = ndc_tri[2] - ndc_tri[0];
-		A[2] = surface_normal;
-
-		mat<3,3> AI = A.invert();
-
-		vec3 i = AI * vec3(varying_uv[1][0] - varying_uv[0][0], varying_uv[2][0] - varying_uv[0][0], 0);
-		vec3 j = AI * vec3(varying_uv[1][1] - varying_uv[0][1], varying_uv[2][1] - varying_uv[0][1], 0);
-
-		// Matrix for change of basis from tangent to object coords
-		mat<3,3> B;
-		B.set_col(0, i.normalized());
-		B.set_col(1, j.normalized());
-		B.set_col(2, surface_normal);
-
-		// Transforming tangent-space normals to object coords
-		vec3 normal = (B*mdl.get_normal(uv)).normalized();
-
-		vec3 n = proj<3>(uniform_M_IT*embed<4>(normal)).normalized(); // transformed normal
-		vec3 l = proj<3>(uniform_M   *embed<4>(light_dir)).normalized(); // transformed light_dir
-		vec3 r = (n*(2.f*n*l) - l).normalized(); // l reflected across the n
-		std::uint32_t texture_color = mdl.get_texture(uv);
-
-		float diffuse = std::max(0.0, n*l);
-		// we take the z component because the camera is on the z-axis after the transformation
-		float specular = std::max(0.0, std::pow(r.z, mdl.get_specular(uv)));
-		std::uint8_t* texture_color_channel = (std::uint8_t*)&texture_color;
-		std::uint8_t* color_channel = (std::uint8_t*)&color;
-		for (int i = 0; i < 3; i++){
-			color_channel[i] = uniform_ambient + texture_color_channel[i]*(1.0*diffuse + 0.6*specular);
-		}
-		return false;
-	};
-};
+// Format of the zbuffer, one of double, float, ReversedFloatDepth,
+// FixedDepth<24>, FixedDepth<32> or FixedDepth<24, true> (reversed), see "depth.h"
+typedef float depth_T;
 
 int main(){
-
+	auto& mdl        = ShaderGlobals<scalar_T>::mdl;
+	auto& light_dir  = ShaderGlobals<scalar_T>::light_dir;
+	auto& ModelView  = ShaderGlobals<scalar_T>::ModelView;
+	auto& Projection = ShaderGlobals<scalar_T>::Projection;
+	auto& Viewport   = ShaderGlobals<scalar_T>::Viewport;
+
+	// Large models are parsed in chunks on the threads that render them later
+	ThreadPool pool(THREADS);
 	int parse_status;
-	parse_status = parse_obj("./res/african_head.obj", &mdl);
-	//parse_status = parse_obj("./res/local/audi/audi5.obj", &mdl);
+	parse_status = parse_obj("./res/african_head.obj", &mdl, pool);
+	//parse_status = parse_obj("./res/local/audi/audi5.obj", &mdl, pool);
 
 	if (parse_status == -1){
 		std::cerr << "Error in the parse\n";
 		return -1;
 	} else {
 		std::cout << "Parsed successfully\n";
-		auto summary = [](std::vector<vec3> v, int n) { 
+		auto summary = [](const std::vector<vec<3,scalar_T>>& v, int n) {
 			std::cout << "Top " << n << '\n';
-			for (int i = 0; i < n && i < v.size(); i++) {
+			for (int i = 0; i < n && i < (int)v.size(); i++) {
 				std::cout << v[i] << '\n';
 			}
 			std::cout << "Bottom " << n << '\n';
-			for (int i = 0; i < n && i < v.size(); i++) {
-				std::cout << v[v.size() - i] << '\n';
+			for (int i = 0; i < n && i < (int)v.size(); i++) {
+				std::cout << v[v.size() - 1 - i] << '\n';
 			}
 			std::cout << '\n';
 		};
@@ -339,35 +95,22 @@ int main(){
 	}
 
 	// Making the model "unit" size
-	double longest = 0;
+	scalar_T longest = 0;
 	for (auto pos : mdl.verts) longest = std::max(longest, pos.norm());
 	std::cout << "Longest=" << longest << '\n';
-	for (auto& pos : mdl.verts) pos = pos/(0.8*longest);
+	mdl.transform_positions([&](auto pos) { return pos/(0.8*longest); });
+	if (OPTIMIZE_FACE_ORDER) mdl.optimize_face_order();
 
 	Image<std::uint32_t> pixels(WIDTH, HEIGHT);
-	Image<double> zbuffer(WIDTH, HEIGHT);
-	img_fill(pixels , BACKGROUND_COLOR);
-	img_fill(zbuffer, std::numeric_limits<double>::lowest());
-
-	TGAImage man_texture;
-	man_texture.read_tga_file("./res/african_head_diffuse.tga");
-	man_texture.write_tga_file("tga_texture_man.tga");
-	Image<std::uint32_t> texture(man_texture);
-
-	TGAImage man_normals;
-	man_normals.read_tga_file("./res/african_head_nm.tga");
-	man_normals.write_tga_file("tga_normals_man.tga");
-	Image<std::uint32_t> normals(man_normals);
-
-	TGAImage man_tangent_normals;
-	man_tangent_normals.read_tga_file("./res/african_head_nm_tangent.tga");
-	man_tangent_normals.write_tga_file("tga_tangent_normals_man.tga");
-	Image<std::uint32_t> tangent_normals(man_tangent_normals);
+	MultisampleTarget<std::uint32_t, depth_T> target(WIDTH, HEIGHT, SAMPLES);
+	img_fill(target.color, BACKGROUND_COLOR);
+	clear_depth(target.depth);
 
-	TGAImage man_specular;
-	man_specular.read_tga_file("./res/african_head_spec.tga");
-	man_specular.write_tga_file("tga_specular_man.tga");
-	Image<std::uint32_t> specular(man_specular);
+	// The mip chains are built here, the normal and specular maps are decoded into floats once
+	Texture<std::uint32_t> texture(Image<std::uint32_t>(TGAFile("./res/african_head_diffuse.tga")));
+	Texture<vec<3,float>> normals(Image<std::uint32_t>(TGAFile("./res/african_head_nm.tga")), decode_normal);
+	Texture<vec<3,float>> tangent_normals(Image<std::uint32_t>(TGAFile("./res/african_head_nm_tangent.tga")), decode_normal);
+	Texture<float> specular(Image<std::uint32_t>(TGAFile("./res/african_head_spec.tga")), decode_red);
 
 	vec3 eye    = vec3{1.0, 0.4, 1.0};
 	vec3 center = vec3{0, 0, 0};
@@ -375,23 +118,23 @@ int main(){
 	double c = 3;
 
 	light_dir  = {0.5, 0.0, 1.0};
-	ModelView  = look_at(eye, center, up)*scale(0.7);
-	Projection = get_projection(c);
-	Viewport   = get_viewport(0, 0, WIDTH, HEIGHT, 255); 
+	ModelView  = mat_cast<scalar_T>(look_at(eye, center, up)*scale(0.7));
+	Projection = mat_cast<scalar_T>(get_projection(c));
+	Viewport   = mat_cast<scalar_T>(get_viewport(0, 0, WIDTH, HEIGHT, DEPTH_RANGE));
 
 	std::cout << "Generated modelview matrix: \n" << ModelView << '\n';
 	std::cout << "Generated projection matrix: \n" << Projection << '\n';
 	std::cout << "Generated viewport matrix: \n" << Viewport << '\n';
 
-	//FlatShader shader{};
-	//PosterizationShader shader{};
-	//CarcassShader shader{};
-	//CutoffShader shader{};
-	//PhongShader shader{};
-	TextureTangentNormalShader shader{};
+	//FlatShader<scalar_T> shader{};
+	//PosterizationShader<scalar_T> shader{};
+	//CarcassShader<scalar_T> shader{};
+	//CutoffShader<scalar_T> shader{};
+	//PhongShader<scalar_T> shader{};
+	TextureTangentNormalShader<scalar_T> shader{};
 
-	shader.uniform_M = Projection*ModelView;
-	shader.uniform_M_IT = (Projection*ModelView).invert_transpose();
+	// uniform_M, uniform_M_IT and the rest of the derived uniforms
+	// are baked by the shader itself at the start of the draw
 	shader.uniform_ambient = 5;
 
 	// Exclusive to PosterizationShader
@@ -402,40 +145,54 @@ int main(){
 	//shader.uniform_to_camera = (eye - center);
 
 	// Exclusive to TextureTangentNormalShader
+	shader.uniform_filter = TEXTURE_FILTER;
 	mdl.m_texturemap = &texture;
 	mdl.m_normalmap = &normals;
 	mdl.m_normalmap = &tangent_normals;
 	mdl.m_specularmap = &specular;
 
-	std::array<vec<4>, 3> screen_coords;
-	for (size_t iface = 0; iface < mdl.face_vrtx.size(); iface += 3){
-		//DEBUG
-		auto begin = std::chrono::high_resolution_clock::now();
-		//ENDDEBUG
-
-		// Reading a face (triangle)
-		for (int nthvert = 0; nthvert < 3; nthvert++){
-			screen_coords[nthvert] = shader.vertex(iface, nthvert);
-			//std::cout << "screen_coord=" << screen_coords[nthvert] << '\n';
-		}
-		draw_shaded_triangle(screen_coords, shader, pixels, zbuffer);
+	// Faces of the obj files are counter-clockwise, so the clockwise ones on the screen face away
+	DrawOptions options = { .cull = CullMode::cw, .deferred = DEFERRED, .perspective = PERSPECTIVE };
 
-		//DEBUG
+	if (BATCH_VIEWS > 0) {
+		// The model, the textures and the shader above are shared by every view
+		std::vector<CameraView> views = orbit_views(eye, center, up, BATCH_VIEWS);
+		BatchOptions batch = { .width = WIDTH, .height = HEIGHT, .samples = SAMPLES, .background = BACKGROUND_COLOR,
+			.model = scale(0.7), .format = OUTPUT_FORMAT, .draw = options };
+		std::cout << "Rendering " << views.size() << " views on " << pool.size() << " threads\n";
+		auto begin = std::chrono::high_resolution_clock::now();
+		int status = render_batch<depth_T>(views, shader, batch, pool);
 		auto end   = std::chrono::high_resolution_clock::now();
-		if (iface%3000 == 0) std::cout << iface << "/" << mdl.face_vrtx.size() << ' ' << ((std::chrono::duration<float>)(end - begin).count()) << "\n";
-		//ENDDEBUG
+		float seconds = ((std::chrono::duration<float>)(end - begin)).count();
+		std::cout << "Rendered " << views.size() << " views in " << seconds << "s, " << views.size() / seconds << " views/s\n";
+		return status;
 	}
 
 	std::string image_name = "output";
-	image_name.append(".ppm");
-	img_save(image_name, pixels);
+	image_name.append(OUTPUT_FORMAT == ImageFormat::png ? ".png" : ".ppm");
+	ImageRowStream output(image_name, WIDTH, HEIGHT, OUTPUT_FORMAT);
+
+	std::cout << "Rendering on " << pool.size() << " threads\n";
+	auto begin = std::chrono::high_resolution_clock::now();
+	// Finished rows are resolved and written while the other tiles render
+	options.rows_done = [&](int y_begin, int y_end) {
+		resolve(target, pixels, y_begin, y_end);
+		output.write_rows(pixels, y_begin, y_end);
+	};
+	DrawStats stats = draw_tiled_indexed(mdl.vertex_index, shader, target, pool, options);
+	auto end   = std::chrono::high_resolution_clock::now();
+	std::cout << "Rendered " << stats.faces << " faces in " << ((std::chrono::duration<float>)(end - begin)).count() << "s\n";
+	std::cout << "Shaded " << stats.shaded_vertices << " vertices, reuse ratio " << stats.vertex_reuse() << '\n';
+	std::cout << "Culled " << stats.culled << " back faces, " << stats.degenerate << " degenerate, "
+		<< stats.offscreen << " off-screen\n";
+	std::cout << "Hierarchical Z rejected " << stats.hiz_rejected << " of " << stats.hiz_tested << " blocks\n";
+	std::cout << "Shaded " << stats.fragments_shaded << " fragments for " << stats.depth_passes << " depth test passes";
+	if (options.deferred) std::cout << ", overdraw " << stats.overdraw();
+	std::cout << '\n';
+
+	if (output.close()) return -1;
 	std::cout << "Completed the render!\n";
 
-	//img_save("tangent_normals.ppm", tangent_normals);
-	//img_save("normals.ppm", normals);
-	//img_save("texture.ppm",  texture);
-	//img_save("specular.ppm",  specular);
-
 	return 0;
 }
 
@@ -0,0 +1,80 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filepath)
+{
+	file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		return;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+		return;
+	length = file_size.QuadPart;
+	open = true;
+	// Empty files cannot be mapped
+	if (length == 0)
+		return;
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		begin = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!begin) {
+		length = 0;
+		open = false;
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (begin)
+		UnmapViewOfFile(begin);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const std::string& filepath)
+{
+	const int fd = ::open(filepath.c_str(), O_RDONLY);
+	if (fd == -1)
+		return;
+	struct stat info;
+	if (fstat(fd, &info) == 0) {
+		length = info.st_size;
+		open = true;
+		// Empty files cannot be mapped
+		if (length > 0) {
+			void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped == MAP_FAILED) {
+				length = 0;
+				open = false;
+			} else {
+				begin = (const char*)mapped;
+				// The file is read front to back once
+				madvise(mapped, length, MADV_SEQUENTIAL);
+			}
+		}
+	}
+	// The mapping keeps the file alive on its own
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (begin)
+		munmap((void*)begin, length);
+}
+#endif
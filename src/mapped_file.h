@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory
+// the pages are read in by the OS on first access, nothing is copied
+// is_open() is false if the file could not be opened or mapped, an empty file maps to size() == 0
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& filepath);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool is_open() const { return open; }
+	const char* data() const { return begin; }
+	std::size_t size() const { return length; }
+
+private:
+	const char* begin = nullptr;
+	std::size_t length = 0;
+	bool open = false;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
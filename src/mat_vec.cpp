@@ -1,5 +1,9 @@
 #include "./mat_vec.h"
 
-vec3 cross(const vec3& p, const vec3& v){
-	return vec3{p.y*v.z - p.z*v.y, p.z*v.x - p.x*v.z, p.x*v.y - p.y*v.x};
+template<class T>
+vec<3,T> cross(const vec<3,T>& p, const vec<3,T>& v){
+	return vec<3,T>{p.y*v.z - p.z*v.y, p.z*v.x - p.x*v.z, p.x*v.y - p.y*v.x};
 }
+
+template vec<3,double> cross(const vec<3,double>& p, const vec<3,double>& v);
+template vec<3,float> cross(const vec<3,float>& p, const vec<3,float>& v);
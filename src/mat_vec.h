@@ -4,176 +4,195 @@
 #include <cmath>
 #include <iostream>
 #include <cassert>
+#include <type_traits>
 
-template<int n>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// T is the scalar type, double by default
+// float vectors/matrices halve the memory traffic and get SIMD kernels below
+template<int n, class T = double>
 struct vec {
-	double data[n] = {0};
-	double& operator[](const int i) {
+	T data[n] = {0};
+	T& operator[](const int i) {
 		assert(i>=0 && i<n);
 		return data[i];
 	}
-	double operator[](const int i) const {
+	T operator[](const int i) const {
 		assert(i>=0 && i<n);
 		return data[i];
 	}
-	double norm2() const {
+	T norm2() const {
 		return (*this)*(*this);
 	}
-	double norm() const{
+	T norm() const{
 		return std::sqrt(norm2());
 	}
 };
 
 // Vector * Vector
-template<int n>
-double operator*(const vec<n>& lhs, const vec<n>& rhs){
-	double ret = 0;
+template<int n, class T>
+T operator*(const vec<n,T>& lhs, const vec<n,T>& rhs){
+	T ret = 0;
 	for (int i = n; i--; ret += lhs[i] * rhs[i]);
 	return ret;
 }
 
-template<int n>
-vec<n> operator+(const vec<n>& lhs, const vec<n>& rhs){
-	vec<n> ret = lhs;
+template<int n, class T>
+vec<n,T> operator+(const vec<n,T>& lhs, const vec<n,T>& rhs){
+	vec<n,T> ret = lhs;
 	for (int i = n; i--; ret[i] += rhs[i]);
 	return ret;
 }
 
-template<int n>
-vec<n> operator-(const vec<n>& lhs, const vec<n>& rhs){
-	vec<n> ret = lhs;
+template<int n, class T>
+vec<n,T> operator-(const vec<n,T>& lhs, const vec<n,T>& rhs){
+	vec<n,T> ret = lhs;
 	for (int i = n; i--; ret[i] -= rhs[i]);
 	return ret;
 }
 
 // Scalar * Vector
-template<int n>
-vec<n> operator*(const double& scale, const vec<n>& rhs){
-	vec<n> ret = rhs;
+// the scalar is converted to the type of the vector
+template<int n, class T>
+vec<n,T> operator*(const std::type_identity_t<T>& scale, const vec<n,T>& rhs){
+	vec<n,T> ret = rhs;
 	for (int i = n; i--; ret[i] *= scale);
 	return ret;
 }
 
 // Vector * Scalar
-template<int n>
-vec<n> operator*(const vec<n>& rhs, const double& scale){
-	vec<n> ret = rhs;
+template<int n, class T>
+vec<n,T> operator*(const vec<n,T>& rhs, const std::type_identity_t<T>& scale){
+	vec<n,T> ret = rhs;
 	for (int i = n; i--; ret[i] *= scale);
 	return ret;
 }
 
 
-template<int n>
-vec<n> operator/(const vec<n>& lhs, const double& scale){
-	vec<n> ret = lhs;
+template<int n, class T>
+vec<n,T> operator/(const vec<n,T>& lhs, const std::type_identity_t<T>& scale){
+	vec<n,T> ret = lhs;
 	for (int i = n; i--; ret[i] /= scale);
 	return ret;
 }
 
 // Emplaces the vector into a larger vector
 // fills new entries with 1 by default
-template<int n1, int n2>
-vec<n1> embed(const vec<n2>& v, double fill=1){
-	vec<n1> ret;
+template<int n1, int n2, class T>
+vec<n1,T> embed(const vec<n2,T>& v, std::type_identity_t<T> fill=1){
+	vec<n1,T> ret;
 	for (int i = 0; i < n1; i++){
 		ret[i] = i < n2 ? v[i] : fill;
 	}
 	return ret;
 }
 
-// Squishes the vector into 
+// Squishes the vector into
 // a smaller vector, discards entries
-template<int n1, int n2>
-vec<n1> proj(const vec<n2> &v){
+template<int n1, int n2, class T>
+vec<n1,T> proj(const vec<n2,T> &v){
 	assert(n2 > n1);
-	vec<n1> ret;
+	vec<n1,T> ret;
 	for (int i = 0; i < n1; i++){
 		ret[i] = v[i];
 	}
 	return ret;
 }
 
-template <int n>
-std::ostream& operator<<(std::ostream& out, const vec<n>& v){
+// Converts the vector to another scalar type
+template<class T_to, int n, class T_from>
+vec<n,T_to> vec_cast(const vec<n,T_from>& v){
+	vec<n,T_to> ret;
+	for (int i = 0; i < n; i++){
+		ret[i] = (T_to)v[i];
+	}
+	return ret;
+}
+
+template <int n, class T>
+std::ostream& operator<<(std::ostream& out, const vec<n,T>& v){
 	for (int i = 0; i < n; i++){
 		out << v[i] << " ";
 	}
 	return out;
 }
 
-template<>
-struct vec<2> {
-	double x = 0;
-	double y = 0;
-	double& operator[](const int i){
+template<class T>
+struct vec<2,T> {
+	T x = 0;
+	T y = 0;
+	T& operator[](const int i){
 		assert(i>=0 && i<2);
 		return i ? y : x;
 	}
-	double operator[](const int i) const {
+	T operator[](const int i) const {
 		assert(i>=0 && i<2);
 		return i ? y : x;
 	}
-	double norm2() const {
+	T norm2() const {
 		return (*this) * (*this);
 	}
-	double norm() const {
+	T norm() const {
 		return std::sqrt(norm2());
 	}
-	vec<2> normalized() {
+	vec<2,T> normalized() {
 		return (*this)/norm();
 	}
 };
 
-template<>
-struct vec<3> {
-	double x = 0;
-	double y = 0;
-	double z = 0;
-	double& operator[](const int i){
+template<class T>
+struct vec<3,T> {
+	T x = 0;
+	T y = 0;
+	T z = 0;
+	T& operator[](const int i){
 		assert(i>=0 && i<3);
 		return i ? (1 == i ? y : z) : x;
 	}
-	double operator[](const int i) const {
+	T operator[](const int i) const {
 		assert(i>=0 && i<3);
 		return i ? (1 == i ? y : z) : x;
 	}
-	double norm2() const {
+	T norm2() const {
 		return (*this) * (*this);
 	}
-	double norm() const {
+	T norm() const {
 		return std::sqrt(norm2());
 	}
-	vec<3> normalized() {
+	vec<3,T> normalized() {
 		return (*this)/norm();
 	}
 };
 
-template<>
-struct vec<4> {
-	double x = 0;
-	double y = 0;
-	double z = 0;
-	double w = 0;
-	double& operator[](const int i){
+// Aligned to its size, so a float vec4 fits exactly into an SSE register
+template<class T>
+struct alignas(4 * sizeof(T)) vec<4,T> {
+	T x = 0;
+	T y = 0;
+	T z = 0;
+	T w = 0;
+	T& operator[](const int i){
 		assert(i>=0 && i<4);
 		return i ? (1 == i ? y : (2 == i ? z : w)) : x;
 	}
-	double operator[](const int i) const {
+	T operator[](const int i) const {
 		assert(i>=0 && i<4);
 		return i ? (1 == i ? y : (2 == i ? z : w)) : x;
 	}
-	double norm2() const {
+	T norm2() const {
 		return (*this) * (*this);
 	}
-	double norm() const {
+	T norm() const {
 		return std::sqrt(norm2());
 	}
-	vec<4> normalized() {
+	vec<4,T> normalized() {
 		return (*this)/norm();
 	}
 	// Equates the w component to 1
 	// and scales others accordingly
-	vec<4> w_normalized() {
+	vec<4,T> w_normalized() {
 		return (*this)/w;
 	}
 };
@@ -182,11 +201,15 @@ typedef vec<2> vec2;
 typedef vec<3> vec3;
 typedef vec<4> vec4;
 
+typedef vec<2,float> vec2f;
+typedef vec<3,float> vec3f;
+typedef vec<4,float> vec4f;
+
 // Transforms to homogeneous coordinates
-template<int N>
-vec<N+1> to_homogeneous(vec<N>& v, double scale){
+template<int N, class T>
+vec<N+1,T> to_homogeneous(vec<N,T>& v, std::type_identity_t<T> scale){
 	static_assert(N > 0);
-	vec<N+1> ret = {};
+	vec<N+1,T> ret = {};
 	for (int i = 0; i < N; i++){
 		ret[i] = v[i]*scale;
 	}
@@ -195,17 +218,18 @@ vec<N+1> to_homogeneous(vec<N>& v, double scale){
 }
 
 // Transforms back to regular coordinates
-template<int N>
-vec<N-1> to_regular(vec<N>& v){
+template<int N, class T>
+vec<N-1,T> to_regular(vec<N,T>& v){
 	static_assert(N > 2);
-	vec<N-1> ret = {};
+	vec<N-1,T> ret = {};
 	for (int i = 0; i < (N-1); i++){
 		ret[i] = v[i]/v[N-1];
 	}
 	return ret;
 }
 
-vec3 cross(const vec3& p, const vec3& v);
+template<class T>
+vec<3,T> cross(const vec<3,T>& p, const vec<3,T>& v);
 
 struct vec2i{
 	int x;
@@ -229,40 +253,40 @@ struct vec3ui{
 	unsigned int z;
 };
 
-template<int n> struct dt;
+template<int n, class T> struct dt;
 
-template<int nrows, int ncols>
+template<int nrows, int ncols, class T = double>
 struct mat {
 	// nrows amount of vectors of length ncols
 	// basically an array
-	vec<ncols> rows[nrows] = {{}};
+	vec<ncols,T> rows[nrows] = {{}};
 
-	vec<ncols>& operator[] (const int idx){
+	vec<ncols,T>& operator[] (const int idx){
 		assert(idx>=0 && idx<nrows);
 		return rows[idx];
 	}
-	const vec<ncols>& operator[] (const int idx) const {
+	const vec<ncols,T>& operator[] (const int idx) const {
 		assert(idx>=0 && idx<nrows);
 		return rows[idx];
 	}
 
 	// Returns a newly constructed copy of a column
-	vec<nrows> col(const int idx) const {
+	vec<nrows,T> col(const int idx) const {
 		assert(idx>=0 && idx<ncols);
-		vec<nrows> ret;
+		vec<nrows,T> ret;
 		for (int i=nrows; i--; ret[i]=rows[i][idx]);
 		return ret;
 	}
 
 	// Modifies the certain column of *this*
-	void set_col(const int idx, const vec<nrows> &v){
+	void set_col(const int idx, const vec<nrows,T> &v){
 		assert(idx>=0 && idx<ncols);
 		for (int i=nrows; i--; rows[i][idx]=v[i]);
 	}
 
 	// Returns a newly created object
-	static mat<nrows,ncols> identity() {
-		mat<nrows, ncols> ret;
+	static mat<nrows,ncols,T> identity() {
+		mat<nrows,ncols,T> ret;
 		for (int i = 0; i < nrows; i++) {
 			for (int j = 0; j < ncols; j++) {
 				ret[i][j] = (i==j);
@@ -271,13 +295,13 @@ struct mat {
 		return ret;
 	}
 
-	double det() const {
-		return dt<ncols>::det(*this);
+	T det() const {
+		return dt<ncols,T>::det(*this);
 	}
 
 	// Returns a matrix with the given row and column removed
-	mat<nrows-1, ncols-1> get_minor(const int row, const int col) const {
-		mat<nrows-1, ncols-1> ret;
+	mat<nrows-1,ncols-1,T> get_minor(const int row, const int col) const {
+		mat<nrows-1,ncols-1,T> ret;
 		for (int i = 0; i < nrows-1; i++) {
 			for (int j = 0; j < ncols-1; j++){
 				ret[i][j] = rows[i<row?i:i+1][j<col?j:j+1];
@@ -286,12 +310,12 @@ struct mat {
 		return ret;
 	}
 
-	double cofactor(const int row, const int col) const {
+	T cofactor(const int row, const int col) const {
 		return get_minor(row,col).det()*((row+col)%2 ? -1 : 1);
 	}
 
-	mat<nrows,ncols> adjugate() const {
-		mat<nrows,ncols> ret;
+	mat<nrows,ncols,T> adjugate() const {
+		mat<nrows,ncols,T> ret;
 		for (int i = 0; i < nrows; i++){
 			for (int j = 0; j < nrows; j++){
 				ret[i][j] = cofactor(i,j);
@@ -300,17 +324,17 @@ struct mat {
 		return ret;
 	}
 
-	mat<nrows,ncols> invert_transpose() const {
-		mat<nrows,ncols> ret = adjugate();
+	mat<nrows,ncols,T> invert_transpose() const {
+		mat<nrows,ncols,T> ret = adjugate();
 		return ret/(ret[0]*rows[0]);
 	}
 
-	mat<nrows,ncols> invert() const {
+	mat<nrows,ncols,T> invert() const {
 		return invert_transpose().transpose();
 	}
 
-	mat<ncols,nrows> transpose() const {
-		mat<ncols,nrows> ret;
+	mat<ncols,nrows,T> transpose() const {
+		mat<ncols,nrows,T> ret;
 		for (int i = 0; i < ncols; i++){
 			ret[i] = this->col(i);
 		}
@@ -318,38 +342,83 @@ struct mat {
 	}
 };
 
+typedef mat<4,4,float> mat4f;
 
-template<int nrows,int ncols> 
-vec<nrows> operator*(const mat<nrows,ncols>& lhs, const vec<ncols>& rhs) {
-	vec<nrows> ret;
+// Converts the matrix to another scalar type
+template<class T_to, int nrows, int ncols, class T_from>
+mat<nrows,ncols,T_to> mat_cast(const mat<nrows,ncols,T_from>& m){
+	mat<nrows,ncols,T_to> ret;
+	for (int i = 0; i < nrows; i++){
+		ret[i] = vec_cast<T_to>(m[i]);
+	}
+	return ret;
+}
+
+template<int nrows, int ncols, class T>
+vec<nrows,T> operator*(const mat<nrows,ncols,T>& lhs, const vec<ncols,T>& rhs) {
+	vec<nrows,T> ret;
 	for (int i = 0; i < nrows; i++){
 		ret[i]=lhs[i]*rhs;
 	}
 	return ret;
 }
 
-// Yea this thing is inefficient
-// because it copies columns
-// I could probably my C linear algebra library
-// from the ml framework but I gotta learn some more c++
-template<int R1, int C1, int C2>
-mat<R1,C2> operator*(const mat<R1,C1>& lhs, const mat<C1,C2>& rhs){
-	mat<R1,C2> result;
+// Sums the products straight from the rows of rhs
+// instead of copying its columns out, the summation order
+// is the same as in the Vector * Vector product
+template<int R1, int C1, int C2, class T>
+mat<R1,C2,T> operator*(const mat<R1,C1,T>& lhs, const mat<C1,C2,T>& rhs){
+	mat<R1,C2,T> result;
 	for (int i = 0; i < R1; i++){
 		for (int j = 0; j < C2; j++){
-			// this is a vector multiplication
-			// adds up to a double
-			result[i][j]=lhs[i]*rhs.col(j);
+			T sum = 0;
+			for (int k = C1; k--; sum += lhs[i][k]*rhs[k][j]);
+			result[i][j] = sum;
 		}
 	}
 	return result;
 }
 
+#if defined(__SSE__)
+// Single precision 4x4 kernels, every row is a 16-byte aligned vec4f
+
+// Row products are transposed so that the four dot products
+// are summed up vertically in one register
+inline vec4f operator*(const mat4f& lhs, const vec4f& rhs) {
+	const __m128 v = _mm_load_ps(&rhs.x);
+	__m128 r0 = _mm_mul_ps(_mm_load_ps(&lhs.rows[0].x), v);
+	__m128 r1 = _mm_mul_ps(_mm_load_ps(&lhs.rows[1].x), v);
+	__m128 r2 = _mm_mul_ps(_mm_load_ps(&lhs.rows[2].x), v);
+	__m128 r3 = _mm_mul_ps(_mm_load_ps(&lhs.rows[3].x), v);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	vec4f ret;
+	_mm_store_ps(&ret.x, _mm_add_ps(_mm_add_ps(r0, r1), _mm_add_ps(r2, r3)));
+	return ret;
+}
+
+// Row i of the result is the rows of rhs weighted by the entries of the row i of lhs
+inline mat4f operator*(const mat4f& lhs, const mat4f& rhs) {
+	const __m128 b0 = _mm_load_ps(&rhs.rows[0].x);
+	const __m128 b1 = _mm_load_ps(&rhs.rows[1].x);
+	const __m128 b2 = _mm_load_ps(&rhs.rows[2].x);
+	const __m128 b3 = _mm_load_ps(&rhs.rows[3].x);
+	mat4f result;
+	for (int i = 0; i < 4; i++){
+		const vec4f& a = lhs.rows[i];
+		__m128 row = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.x), b0), _mm_mul_ps(_mm_set1_ps(a.y), b1)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.z), b2), _mm_mul_ps(_mm_set1_ps(a.w), b3)));
+		_mm_store_ps(&result.rows[i].x, row);
+	}
+	return result;
+}
+#endif
+
 // Matrix * Scalar
 // basically multiplies all of the entries by val
-template<int nrows,int ncols>
-mat<nrows,ncols> operator*(const mat<nrows,ncols>& lhs, const double& val) {
-    mat<nrows,ncols> result;
+template<int nrows, int ncols, class T>
+mat<nrows,ncols,T> operator*(const mat<nrows,ncols,T>& lhs, const std::type_identity_t<T>& val) {
+    mat<nrows,ncols,T> result;
     for (int i = 0; i < nrows; i++){
 	    result[i] = lhs[i]*val;
     }
@@ -358,17 +427,17 @@ mat<nrows,ncols> operator*(const mat<nrows,ncols>& lhs, const double& val) {
 
 // Matrix / Scalar
 // divides all entries by val
-template<int nrows,int ncols>
-mat<nrows,ncols> operator/(const mat<nrows,ncols>& lhs, const double& val) {
-    mat<nrows,ncols> result;
+template<int nrows, int ncols, class T>
+mat<nrows,ncols,T> operator/(const mat<nrows,ncols,T>& lhs, const std::type_identity_t<T>& val) {
+    mat<nrows,ncols,T> result;
     for (int i=nrows; i--; result[i] = lhs[i]/val);
     return result;
 }
 
 // Matrix + Matrix
-template<int nrows,int ncols>
-mat<nrows,ncols> operator+(const mat<nrows,ncols>& lhs, const mat<nrows,ncols>& rhs) {
-    mat<nrows,ncols> result;
+template<int nrows, int ncols, class T>
+mat<nrows,ncols,T> operator+(const mat<nrows,ncols,T>& lhs, const mat<nrows,ncols,T>& rhs) {
+    mat<nrows,ncols,T> result;
     for (int i = 0; i < nrows; i++) {
         for (int j = 0; j < ncols; j++) {
 		result[i][j] = lhs[i][j] + rhs[i][j];
@@ -379,27 +448,27 @@ mat<nrows,ncols> operator+(const mat<nrows,ncols>& lhs, const mat<nrows,ncols>&
 }
 
 // Matrix - Matrix
-template<int nrows,int ncols>
-mat<nrows,ncols> operator-(const mat<nrows,ncols>& lhs, const mat<nrows,ncols>& rhs) {
-    mat<nrows,ncols> result;
+template<int nrows, int ncols, class T>
+mat<nrows,ncols,T> operator-(const mat<nrows,ncols,T>& lhs, const mat<nrows,ncols,T>& rhs) {
+    mat<nrows,ncols,T> result;
     for (int i=nrows; i--; )
         for (int j=ncols; j--; result[i][j]=lhs[i][j]-rhs[i][j]);
     return result;
 }
 
 // Printing out a matrix
-template<int nrows,int ncols>
-std::ostream& operator<<(std::ostream& out, const mat<nrows,ncols>& m) {
-    for (int i=0; i<nrows; i++) 
+template<int nrows, int ncols, class T>
+std::ostream& operator<<(std::ostream& out, const mat<nrows,ncols,T>& m) {
+    for (int i=0; i<nrows; i++)
 	    out << m[i] << '\n';
     return out;
 }
 
 // Determinant of an n-by-n matrix
-template<int n> 
+template<int n, class T>
 struct dt {
-    static double det(const mat<n,n>& src) {
-        double ret = 0;
+    static T det(const mat<n,n,T>& src) {
+        T ret = 0;
         for (int i = 0; i < n; i++){
 		ret += src[0][i]*src.cofactor(0, i);
 	}
@@ -407,9 +476,9 @@ struct dt {
     }
 };
 
-template<> 
-struct dt<1> {
-    static double det(const mat<1,1>& src) {
+template<class T>
+struct dt<1,T> {
+    static T det(const mat<1,1,T>& src) {
         return src[0][0];
     }
 };
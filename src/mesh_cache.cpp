@@ -0,0 +1,218 @@
+#include "mesh_cache.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <process.h>
+static int process_id() { return _getpid(); }
+#else
+#include <unistd.h>
+static int process_id() { return getpid(); }
+#endif
+
+// Arrays of a model in the order of the cache, mdl may be const
+constexpr int MESH_CACHE_ARRAYS = 11;
+template <class Model, class Fn> static void for_each_array(Model& mdl, Fn&& fn)
+{
+	fn(mdl.verts);
+	fn(mdl.tex_coords);
+	fn(mdl.normals);
+	fn(mdl.tangents);
+	fn(mdl.bitangents);
+	fn(mdl.face_vrtx);
+	fn(mdl.face_tex);
+	fn(mdl.face_norm);
+	fn(mdl.vertex_index.corner_vertex);
+	fn(mdl.vertex_index.vertex_corner);
+	fn(mdl.vertices);
+}
+
+struct MeshCacheHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t scalar_size; // sizeof(T) of the BasicModel<T>
+	std::uint32_t has_tex_coords;
+	std::uint32_t has_normals;
+	std::uint64_t source_size;
+	std::int64_t source_mtime; // In the ticks of std::filesystem::file_time_type
+	std::uint64_t source_hash;
+	std::uint64_t counts[MESH_CACHE_ARRAYS]; // Elements of every array
+};
+
+// Every array starts 8 byte aligned, the mapping itself is page aligned
+static std::uint64_t padded(std::uint64_t bytes)
+{
+	return (bytes + 7) & ~(std::uint64_t)7;
+}
+
+// FNV-1a over 64 bit words, the tail byte by byte
+static std::uint64_t hash_text(const char* data, std::size_t size)
+{
+	constexpr std::uint64_t prime = 0x100000001b3;
+	std::uint64_t hash = 0xcbf29ce484222325;
+	std::size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		std::uint64_t word;
+		std::memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ (unsigned char)data[i]) * prime;
+	return hash;
+}
+
+static bool source_stamp(const std::string& filepath, std::uint64_t& size, std::int64_t& mtime)
+{
+	std::error_code error;
+	size = std::filesystem::file_size(filepath, error);
+	if (error)
+		return false;
+	mtime = std::filesystem::last_write_time(filepath, error).time_since_epoch().count();
+	return !error;
+}
+
+std::string mesh_cache_path(const std::string& filepath)
+{
+	return filepath + ".mesh";
+}
+
+// load_mesh_cache while the cache is mapped, mtime is the time of the .obj,
+// stale_time tells that it differs from the one of the cache although the text is the same
+template <class T>
+static bool read_mesh_cache(const std::string& filepath, BasicModel<T>* mdl, std::int64_t& mtime, bool& stale_time)
+{
+	MappedFile cache(mesh_cache_path(filepath));
+	MeshCacheHeader header;
+	if (!cache.is_open() || cache.size() < sizeof(header))
+		return false;
+	std::memcpy(&header, cache.data(), sizeof(header));
+	if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) || header.version != MESH_CACHE_VERSION
+		|| header.scalar_size != sizeof(T))
+		return false;
+
+	std::uint64_t size;
+	if (!source_stamp(filepath, size, mtime) || size != header.source_size)
+		return false;
+	// A copied or touched .obj gets a new time, its text decides
+	stale_time = mtime != header.source_mtime;
+	if (stale_time) {
+		MappedFile source(filepath);
+		if (!source.is_open() || hash_text(source.data(), source.size()) != header.source_hash)
+			return false;
+	}
+
+	// The arrays have to fit before any of them is touched
+	std::uint64_t end = sizeof(header);
+	int array = 0;
+	bool fits = true;
+	for_each_array(*mdl, [&](const auto& values) {
+		const std::uint64_t count = header.counts[array++];
+		fits = fits && count <= cache.size() && end + padded(count * sizeof(values[0])) <= cache.size();
+		if (fits)
+			end += padded(count * sizeof(values[0]));
+	});
+	if (!fits)
+		return false;
+
+	const char* pos = cache.data() + sizeof(header);
+	array = 0;
+	for_each_array(*mdl, [&](auto& values) {
+		const std::uint64_t count = header.counts[array++];
+		values.resize(count);
+		if (count)
+			std::memcpy(values.data(), pos, count * sizeof(values[0]));
+		pos += padded(count * sizeof(values[0]));
+	});
+	mdl->has_tex_coords = header.has_tex_coords;
+	mdl->has_normals = header.has_normals;
+	return true;
+}
+
+// Writes mtime over the source time in the header of the cache of filepath, a failure only costs a hash on the next load
+// if another process replaced the cache meanwhile, the time still matches its text or its hash is checked again
+static void restamp_mesh_cache(const std::string& filepath, std::int64_t mtime)
+{
+	std::fstream cache(mesh_cache_path(filepath), std::ios::in | std::ios::out | std::ios::binary);
+	cache.seekp(offsetof(MeshCacheHeader, source_mtime));
+	cache.write((const char*)&mtime, sizeof(mtime));
+}
+
+// Name of a temporary file next to path, unique to the process and the call
+static std::string temporary_path(const std::string& path)
+{
+	static std::atomic<unsigned int> calls { 0 };
+	return path + "." + std::to_string(process_id()) + "." + std::to_string(calls++) + ".tmp";
+}
+
+template <class T>
+bool load_mesh_cache(const std::string& filepath, BasicModel<T>* mdl)
+{
+	std::int64_t mtime;
+	bool stale_time = false;
+	if (!read_mesh_cache(filepath, mdl, mtime, stale_time))
+		return false;
+	// Restamped once the cache is unmapped, so that the next load does not hash the .obj again
+	if (stale_time)
+		restamp_mesh_cache(filepath, mtime);
+	return true;
+}
+
+template <class T>
+bool write_mesh_cache(const std::string& filepath, const BasicModel<T>& mdl)
+{
+	static_assert(std::is_trivially_copyable_v<vec<3, T>> && sizeof(vec<3, T>) == 3 * sizeof(T));
+	static_assert(std::is_trivially_copyable_v<MeshVertex<T>>);
+	MeshCacheHeader header = {};
+	std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.scalar_size = sizeof(T);
+	header.has_tex_coords = mdl.has_tex_coords;
+	header.has_normals = mdl.has_normals;
+	{
+		MappedFile source(filepath);
+		if (!source.is_open() || !source_stamp(filepath, header.source_size, header.source_mtime))
+			return false;
+		header.source_hash = hash_text(source.data(), source.size());
+	}
+	int array = 0;
+	for_each_array(mdl, [&](const auto& values) { header.counts[array++] = values.size(); });
+
+	const std::string path = mesh_cache_path(filepath);
+	const std::string temporary = temporary_path(path);
+	std::ofstream out(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "MESH CACHE: Could not write " << temporary << '\n';
+		return false;
+	}
+	out.write((const char*)&header, sizeof(header));
+	for_each_array(mdl, [&](const auto& values) {
+		const std::uint64_t bytes = values.size() * sizeof(values[0]);
+		const char zeros[8] = {};
+		out.write((const char*)values.data(), bytes);
+		out.write(zeros, padded(bytes) - bytes);
+	});
+	out.close();
+	const bool written = !out.fail();
+	std::error_code error;
+	if (written)
+		std::filesystem::rename(temporary, path, error);
+	if (!written || error) {
+		std::cerr << "MESH CACHE: Could not write " << path << '\n';
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+	return true;
+}
+
+template bool load_mesh_cache(const std::string& filepath, BasicModel<double>* mdl);
+template bool load_mesh_cache(const std::string& filepath, BasicModel<float>* mdl);
+template bool write_mesh_cache(const std::string& filepath, const BasicModel<double>& mdl);
+template bool write_mesh_cache(const std::string& filepath, const BasicModel<float>& mdl);
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "./model.h"
+
+// Binary copy of a parsed model, written next to its .obj as <filepath>.mesh
+// a header followed by the arrays of the model in their memory layout (native byte order),
+// loading one copies the arrays out of the mapped file, there is nothing to parse or compute
+// The header holds the size, modification time and hash of the .obj it was made from,
+// the cache is stale once the size differs, or the time differs and so does the hash,
+// a cache whose text still matches gets the new time, so that only the first load after a touch hashes the .obj
+constexpr char MESH_CACHE_MAGIC[8] = { 'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E' };
+// Bump whenever the layout or the parsing of the models changes
+constexpr std::uint32_t MESH_CACHE_VERSION = 3;
+
+std::string mesh_cache_path(const std::string& filepath);
+
+// Replaces the arrays, attribute flags, tangents, vertex index and vertices of mdl with the cache of the .obj at filepath
+// returns false, leaving mdl as it was, if there is no cache, it is stale or it was made for another scalar type
+// Defined for BasicModel<double> and BasicModel<float>
+template <class T>
+bool load_mesh_cache(const std::string& filepath, BasicModel<T>* mdl);
+
+// Writes the cache of mdl, which was parsed from the .obj at filepath
+// goes through a temporary file unique to the process and the call, so a concurrent load never sees half of it
+// and concurrent writers of the same cache do not write into the same file
+// Defined for BasicModel<double> and BasicModel<float>
+template <class T>
+bool write_mesh_cache(const std::string& filepath, const BasicModel<T>& mdl);
@@ -1,11 +1,52 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <unordered_map>
 #include <vector>
 
 #include "image.h"
 #include "mat_vec.h"
+#include "texture.h"
 
-class Model{
+// Entry of face_tex and face_norm for a face corner without that attribute, see fill_missing_attributes
+constexpr int MISSING_INDEX = -1;
+
+// Simulated vertex cache of BasicModel::optimize_face_order, in vertices
+constexpr int FACE_ORDER_CACHE_SIZE = 16;
+
+// Index buffer of a mesh, face corners that share position, uv and normal
+// are one vertex, so that the vertex stage runs once for all of them
+struct VertexIndex {
+	std::vector<int> corner_vertex{}; // Unique vertex of every face corner
+	std::vector<int> vertex_corner{}; // First face corner of every unique vertex
+};
+
+// Every attribute of a unique vertex, interleaved so that the vertex stage reads one place
+template <class T> struct MeshVertex {
+	vec<3,T> position;
+	vec<3,T> normal;
+	vec<3,T> tex_coord;
+	vec<3,T> tangent;
+	vec<3,T> bitangent;
+};
+
+// Attribute indices of a face corner, the key build_vertex_index welds by
+struct CornerAttributes {
+	int vrtx;
+	int tex;
+	int norm;
+	bool operator==(const CornerAttributes&) const = default;
+};
+
+// Hashes the position alone, the few corners of a position that differ in the rest are told apart
+// by comparing, and faces close in the file use positions close in the table
+struct CornerAttributesHash {
+	std::size_t operator()(const CornerAttributes& corner) const { return corner.vrtx; }
+};
+
+// T is the scalar type of the vertex attributes
+template <class T>
+class BasicModel{
 public:
 	int nverts() const {
 		return this->verts.size();
@@ -13,44 +54,247 @@ public:
 	int nfaces() const{
 		return this->face_vrtx.size()/3;
 	}
-	std::vector<vec3> verts{};
-	std::vector<vec3> tex_coords{};
-	std::vector<vec3> normals{};
+	std::vector<vec<3,T>> verts{};
+	std::vector<vec<3,T>> tex_coords{};
+	std::vector<vec<3,T>> normals{};
 	// These contain the indices of vertices
 	// each face has 3 vertices, they are not separated in the vector
-	std::vector<int> face_vrtx; 
-	std::vector<int> face_tex; 
-	std::vector<int> face_norm; 
+	// face_tex and face_norm have an entry for every corner as well
+	std::vector<int> face_vrtx;
+	std::vector<int> face_tex;
+	std::vector<int> face_norm;
+
+	// Whether any face corner came with the attribute, see fill_missing_attributes
+	// shaders and draws that would only read defaults can skip the attribute without them
+	bool has_tex_coords = false;
+	bool has_normals = false;
+
+	// Points the MISSING_INDEX entries of face_tex and face_norm to real elements,
+	// so that every corner can be read without checking, done once at load time
+	// corners without a texture coordinate get a (0, 0) appended to tex_coords,
+	// faces with corners without a normal get their flat normal appended to normals
+	void fill_missing_attributes() {
+		const auto missing = [](int index) { return index == MISSING_INDEX; };
+		has_tex_coords = !std::all_of(face_tex.begin(), face_tex.end(), missing);
+		has_normals = !std::all_of(face_norm.begin(), face_norm.end(), missing);
+		if (std::any_of(face_tex.begin(), face_tex.end(), missing)) {
+			const int default_tex = tex_coords.size();
+			tex_coords.push_back(vec<3,T>{});
+			std::replace(face_tex.begin(), face_tex.end(), MISSING_INDEX, default_tex);
+		}
+		for (size_t face = 0; face < face_norm.size(); face += 3) {
+			if (!missing(face_norm[face]) && !missing(face_norm[face + 1]) && !missing(face_norm[face + 2])) continue;
+			const vec<3,T> e1 = verts[face_vrtx[face + 1]] - verts[face_vrtx[face]];
+			const vec<3,T> e2 = verts[face_vrtx[face + 2]] - verts[face_vrtx[face]];
+			vec<3,T> normal = cross(e1, e2);
+			// Degenerate faces cover no pixels, any unit normal does
+			normal = normal.norm2() > 0 ? normal.normalized() : vec<3,T>{0, 0, 1};
+			for (int i = 0; i < 3; i++) {
+				if (missing(face_norm[face + i])) face_norm[face + i] = normals.size();
+			}
+			normals.push_back(normal);
+		}
+	}
+
+	// Tangent frame of every texture coordinate, indexed through face_tex like tex_coords
+	// tangents point along +u and bitangents along +v, both in object coords
+	std::vector<vec<3,T>> tangents{};
+	std::vector<vec<3,T>> bitangents{};
+
+	// Accumulates dP/du and dP/dv of every face into its texture coordinates
+	// done once at load time, so that shaders only interpolate the result
+	void compute_tangents() {
+		tangents.assign(tex_coords.size(), vec<3,T>{});
+		bitangents.assign(tex_coords.size(), vec<3,T>{});
+		if (face_tex.size() != face_vrtx.size()) return;
+		for (size_t face = 0; face < face_vrtx.size(); face += 3) {
+			const vec<3,T> e1 = verts[face_vrtx[face + 1]] - verts[face_vrtx[face]];
+			const vec<3,T> e2 = verts[face_vrtx[face + 2]] - verts[face_vrtx[face]];
+			const vec<3,T> d1 = tex_coords[face_tex[face + 1]] - tex_coords[face_tex[face]];
+			const vec<3,T> d2 = tex_coords[face_tex[face + 2]] - tex_coords[face_tex[face]];
+			const T r = d1.x*d2.y - d2.x*d1.y;
+			if (r == 0) continue; // Degenerate uv mapping
+			const vec<3,T> t = (e1*d2.y - e2*d1.y)/r;
+			const vec<3,T> b = (e2*d1.x - e1*d2.x)/r;
+			for (int i = 0; i < 3; i++) {
+				tangents[face_tex[face + i]] = tangents[face_tex[face + i]] + t;
+				bitangents[face_tex[face + i]] = bitangents[face_tex[face + i]] + b;
+			}
+		}
+		for (size_t i = 0; i < tangents.size(); i++) {
+			if (tangents[i].norm2() > 0) tangents[i] = tangents[i].normalized();
+			if (bitangents[i].norm2() > 0) bitangents[i] = bitangents[i].normalized();
+		}
+	}
+
+	VertexIndex vertex_index{};
+	// Unique vertices of vertex_index, what the indexed shaders read
+	// they hold copies of the attributes: move the positions with transform_positions,
+	// changes to the other attributes need a build_vertex_index
+	std::vector<MeshVertex<T>> vertices{};
 
-	Image<std::uint32_t>* m_texturemap;
-	Image<std::uint32_t>* m_normalmap;
-	Image<std::uint32_t>* m_specularmap;
+	// Replaces every position by fn(position), in verts and in the welded vertices alike
+	// fn has to give the same result for the same position
+	template <class Fn> void transform_positions(Fn&& fn) {
+		for (auto& pos : verts) pos = fn(pos);
+		for (auto& vertex : vertices) vertex.position = fn(vertex.position);
+	}
+
+	// Welds the face corners into vertex_index and vertices, corners are one vertex
+	// if their position, uv and normal indices are, the tangents have to be computed before
+	// unique vertices are numbered in the order they first appear in the faces
+	void build_vertex_index() {
+		vertex_index.corner_vertex.resize(face_vrtx.size());
+		vertex_index.vertex_corner.clear();
+		vertices.clear();
+		const bool has_tex = face_tex.size() == face_vrtx.size();
+		const bool has_norm = face_norm.size() == face_vrtx.size();
+		const bool has_tangents = has_tex && tangents.size() == tex_coords.size();
+		std::unordered_map<CornerAttributes, int, CornerAttributesHash> welded;
+		// Meshes usually have about as many vertices as positions
+		welded.reserve(verts.size() * 2);
+		vertices.reserve(verts.size() * 2);
+		for (size_t corner = 0; corner < face_vrtx.size(); corner++) {
+			const CornerAttributes key = { face_vrtx[corner], has_tex ? face_tex[corner] : MISSING_INDEX,
+				has_norm ? face_norm[corner] : MISSING_INDEX };
+			auto [it, inserted] = welded.try_emplace(key, (int)vertices.size());
+			if (inserted) {
+				MeshVertex<T> vertex;
+				vertex.position = verts[key.vrtx];
+				if (has_norm) vertex.normal = normals[key.norm];
+				if (has_tex) vertex.tex_coord = tex_coords[key.tex];
+				if (has_tangents) {
+					vertex.tangent = tangents[key.tex];
+					vertex.bitangent = bitangents[key.tex];
+				}
+				vertices.push_back(vertex);
+				vertex_index.vertex_corner.push_back(corner);
+			}
+			vertex_index.corner_vertex[corner] = it->second;
+		}
+	}
+
+	// Reorders the faces with Tipsify (Sander, Nehab and Barczak 2007), so that the faces that
+	// share vertices come close together, then rebuilds the vertex index in the new order,
+	// which numbers the vertices in the order they are first used
+	// The triangle assembly of draw_tiled_indexed then reads the shaded vertices mostly from cache
+	// Needs the vertex index, the fanning keeps about cache_size vertices in use at a time
+	void optimize_face_order(int cache_size = FACE_ORDER_CACHE_SIZE) {
+		const std::vector<int>& index = vertex_index.corner_vertex;
+		const int nvertices = vertex_index.vertex_corner.size();
+		const int nfaces = index.size() / 3;
+
+		// Faces around every vertex, those of vertex v are adjacent[first[v]] to adjacent[first[v + 1] - 1]
+		std::vector<int> first(nvertices + 1, 0);
+		for (int vertex : index) first[vertex + 1]++;
+		for (int vertex = 0; vertex < nvertices; vertex++) first[vertex + 1] += first[vertex];
+		std::vector<int> adjacent(index.size());
+		std::vector<int> live(nvertices); // Faces around the vertex that were not emitted yet
+		for (int vertex = 0; vertex < nvertices; vertex++) live[vertex] = first[vertex + 1] - first[vertex];
+		{
+			std::vector<int> next(first.begin(), first.end() - 1);
+			for (size_t corner = 0; corner < index.size(); corner++) adjacent[next[index[corner]]++] = corner / 3;
+		}
+
+		std::vector<int> order;
+		order.reserve(nfaces);
+		std::vector<bool> emitted(nfaces, false);
+		std::vector<int> stamp(nvertices, 0); // Time the vertex last entered the cache
+		std::vector<int> dead_end; // Vertices of the emitted faces, the latest on top
+		std::vector<int> candidates;
+		int time = cache_size + 1;
+		int cursor = 0;
+		int fan = nvertices > 0 ? 0 : -1;
+		while (fan >= 0) {
+			// Emits every face around the fanning vertex
+			candidates.clear();
+			for (int i = first[fan]; i < first[fan + 1]; i++) {
+				const int face = adjacent[i];
+				if (emitted[face]) continue;
+				emitted[face] = true;
+				order.push_back(face);
+				for (int k = 0; k < 3; k++) {
+					const int vertex = index[3 * face + k];
+					dead_end.push_back(vertex);
+					candidates.push_back(vertex);
+					live[vertex]--;
+					if (time - stamp[vertex] > cache_size) stamp[vertex] = time++;
+				}
+			}
+			// Next is the candidate that entered the cache the earliest and would still be in it
+			// after emitting its faces, any candidate with faces left if none would
+			fan = -1;
+			int best = -1;
+			for (int vertex : candidates) {
+				if (live[vertex] == 0) continue;
+				const int age = time - stamp[vertex];
+				const int priority = age + 2 * live[vertex] <= cache_size ? age : 0;
+				if (priority > best) {
+					best = priority;
+					fan = vertex;
+				}
+			}
+			// Dead end, the most recent vertex with faces left, otherwise the next one in the index
+			while (fan < 0 && !dead_end.empty()) {
+				if (live[dead_end.back()] > 0) fan = dead_end.back();
+				dead_end.pop_back();
+			}
+			for (; fan < 0 && cursor < nvertices; cursor++) {
+				if (live[cursor] > 0) fan = cursor;
+			}
+		}
+
+		const auto reorder = [&](std::vector<int>& corners) {
+			if (corners.size() != index.size()) return;
+			std::vector<int> reordered(corners.size());
+			for (int face = 0; face < nfaces; face++)
+				std::copy_n(corners.begin() + 3 * order[face], 3, reordered.begin() + 3 * face);
+			corners.swap(reordered);
+		};
+		reorder(face_vrtx);
+		reorder(face_tex);
+		reorder(face_norm);
+		build_vertex_index();
+	}
+
+	const Texture<std::uint32_t>* m_texturemap;
+	const Texture<vec<3,float>>* m_normalmap; // Decoded with decode_normal
+	const Texture<float>* m_specularmap; // Decoded with decode_red
 
-	// Accesses the texture map
+	// Accesses the texture map, nearest texel of the full resolution level
 	// uv.y is inverted (1-uv.y)
-	std::uint32_t get_texture(vec2 uv) const {
-		return m_texturemap->get_pixel(std::min(m_texturemap->width*uv.x, (double)m_texturemap->width-1), 
-				  std::min(m_texturemap->height*(1-uv.y), (double)m_texturemap->height-1));
+	std::uint32_t get_texture(vec<2,T> uv) const {
+		return TexelFormat<std::uint32_t>::pack(m_texturemap->texel(0, std::min(m_texturemap->width(0)*uv.x, (T)m_texturemap->width(0)-1),
+				  std::min(m_texturemap->height(0)*(1-uv.y), (T)m_texturemap->height(0)-1)));
 	}
 
 	// Accesses the normal map
 	// uv.y is inverted (1-uv.y)
-	vec3 get_normal(vec2 uv) const {
-		std::uint32_t color = m_normalmap->get_pixel(
-			std::min(m_normalmap->width*uv.x,      (double)m_normalmap->width-1), 
-			std::min(m_normalmap->height*(1-uv.y), (double)m_normalmap->height-1));
-		vec3 res;
-		// x = red, y = green, z = blue
-		res[0] = ((color&0x000000ff)>>0)/255.f * 2.f - 1.f;
-		res[1] = ((color&0x0000ff00)>>8)/255.f * 2.f - 1.f;
-		res[2] = ((color&0x00ff0000)>>16)/255.f * 2.f - 1.f;
-		return res;
-	}
-
-	std::uint8_t get_specular(vec2 uv) const {
-		std::uint8_t exponent = m_specularmap->get_pixel(std::min(m_specularmap->width*uv.x, (double)m_specularmap->width-1), 
-			 std::min(m_specularmap->height*(1-uv.y), (double)m_specularmap->height-1));
-		return exponent;
+	vec<3,T> get_normal(vec<2,T> uv) const {
+		return vec_cast<T>(m_normalmap->texel(0,
+			std::min(m_normalmap->width(0)*uv.x,      (T)m_normalmap->width(0)-1),
+			std::min(m_normalmap->height(0)*(1-uv.y), (T)m_normalmap->height(0)-1)));
+	}
+
+	T get_specular(vec<2,T> uv) const {
+		return m_specularmap->texel(0, std::min(m_specularmap->width(0)*uv.x, (T)m_specularmap->width(0)-1),
+			 std::min(m_specularmap->height(0)*(1-uv.y), (T)m_specularmap->height(0)-1));
+	}
+
+	// Filtered versions of the accessors, gradient holds the screen space derivatives of uv
+	// the texture channels stay floats in [0, 255], the normal is not normalized
+	vec<4,float> get_texture(vec<2,T> uv, const TextureGradient& gradient, TextureFilter filter) const {
+		return m_texturemap->sample(vec_cast<float>(uv), gradient, filter);
+	}
+
+	vec<3,T> get_normal(vec<2,T> uv, const TextureGradient& gradient, TextureFilter filter) const {
+		return vec_cast<T>(m_normalmap->sample(vec_cast<float>(uv), gradient, filter));
+	}
+
+	T get_specular(vec<2,T> uv, const TextureGradient& gradient, TextureFilter filter) const {
+		return m_specularmap->sample(vec_cast<float>(uv), gradient, filter);
 	}
 };
 
+typedef BasicModel<double> Model;
+typedef BasicModel<float> ModelF;
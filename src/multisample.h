@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+#include "image.h"
+#include "rasterizer.h"
+
+// Color and depth of a multisampled draw, every pixel has "samples" of both stored next to each other,
+// the sample s of the pixel (x, y) is at (y*width + x)*samples + s of color and depth
+// Draws shade once per pixel and triangle and write the color to the covered samples,
+// resolve averages them into a canvas afterwards
+template <class pixel_T, class depth_T> struct MultisampleTarget {
+	MultisampleTarget(int _width, int _height, int _samples)
+		: width(_width),
+		height(_height),
+		samples(sample_pattern(_samples) ? _samples : 1),
+		color(width * samples, height),
+		depth(width * samples, height)
+	{
+		if (samples != _samples) {
+			std::cerr << "Unsupported sample count " << _samples << " in MultisampleTarget, using 1\n";
+		}
+	}
+
+	// Bounding box widening of the triangles drawn into the target, see setup_triangle_edges
+	double sample_reach() const { return samples > 1 ? SAMPLE_REACH : 0; }
+
+	const int width;
+	const int height;
+	const int samples;
+	Image<pixel_T> color;
+	Image<depth_T> depth;
+};
+
+// Averages the samples of the pixel rows [y_begin, y_end) of the target into the canvas, channel by channel
+// pixels whose samples are all the same (everything but the triangle edges) are copied
+// Disjoint rows can be resolved by several threads at once, see DrawOptions::rows_done
+template <class depth_T>
+void resolve(const MultisampleTarget<std::uint32_t, depth_T>& target, Image<std::uint32_t>& canvas, int y_begin, int y_end)
+{
+	if (canvas.width != (unsigned int)target.width || canvas.height != (unsigned int)target.height) {
+		std::cerr << "Canvas size does not match the MultisampleTarget in resolve\n";
+		return;
+	}
+	const int samples = target.samples;
+	const std::uint32_t* color = target.color.data.get() + (std::size_t)y_begin * target.width * samples;
+	for (int pixel = y_begin * target.width; pixel < y_end * target.width; pixel++, color += samples) {
+		if (std::all_of(color + 1, color + samples, [&](std::uint32_t sample) { return sample == color[0]; })) {
+			canvas[pixel] = color[0];
+			continue;
+		}
+		std::uint32_t resolved = 0;
+		for (int shift = 0; shift < 32; shift += 8) {
+			int sum = 0;
+			for (int s = 0; s < samples; s++)
+				sum += (color[s] >> shift) & 0xff;
+			resolved |= (std::uint32_t)((sum + samples / 2) / samples) << shift;
+		}
+		canvas[pixel] = resolved;
+	}
+}
+
+// Resolves the whole target
+template <class depth_T>
+void resolve(const MultisampleTarget<std::uint32_t, depth_T>& target, Image<std::uint32_t>& canvas)
+{
+	resolve(target, canvas, 0, target.height);
+}
@@ -1,215 +1,509 @@
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 #include <iostream>
 #include <string>
+#include "./mapped_file.h"
+#include "./mesh_cache.h"
 #include "./model.h"
 #include "./parser.h"
+#include "./thread_pool.h"
+
+const char* obj_error_message(ObjError error){
+	switch (error) {
+	case ObjError::none: return "no error";
+	case ObjError::cannot_open: return "could not open";
+	case ObjError::bad_vertex: return "vertex without three coordinates";
+	case ObjError::bad_tex_coord: return "texture coordinate without a number";
+	case ObjError::bad_normal: return "normal without three coordinates";
+	case ObjError::bad_face: return "face without three vertex indices or with an index out of range";
+	}
+	return "unknown error";
+}
 
 // Helper Functions
 
 namespace ObjParser {
 
-constexpr bool is_num(const char c) {
-	return (47 < c) && (c < 58);
+// Spaces, tabs and the '\r' of CRLF line breaks
+static bool is_ws(const char c){
+	return c == ' ' || c == '\t' || c == '\r';
 }
 
-// Starts at a whitespace and continues until a non-whitespace character is found
-void skip_ws(const std::string& s, unsigned int& idx){
-	if (s[idx] != ' ') return;
-	for (; idx < s.size(); idx++){
-		if (s[idx] != ' ') return;
-	}
-	idx++;
-	return;
+// Stops on the first non-whitespace character
+const char* skip_ws(const char* pos, const char* end){
+	while (pos < end && is_ws(*pos)) pos++;
+	return pos;
 }
 
-// Starts at a non-whitespace and stops on a whitespace
-void skip_to_ws(const std::string& s, unsigned int& idx){
-	for (; idx < s.size(); idx++){
-		if (s[idx] == ' ') return;
-	}
-	idx++;
-	return;
+// Stops on the first whitespace character
+const char* skip_to_ws(const char* pos, const char* end){
+	while (pos < end && !is_ws(*pos)) pos++;
+	return pos;
 }
 
-// Starts at a character that is not a forward-slash and stops on a forward-slash
-// if it starts on a forward-slash, then it stops on the next forward slash
-// if no forward-slashes are found after the given index, it returns npos
-void skip_to_fs(const std::string& s, unsigned int& idx){
-	for (; idx < s.size(); idx++){
-		if (s[idx] == '/') return;
-	}
-	idx++;
-	return;
+static bool is_digit(const char c){
+	return '0' <= c && c <= '9';
 }
 
-// Leaves the idx on the first non-numeric value
-// (numeric: 0..9)
-void skip_num(const std::string& s, unsigned int& idx){
-	for (; idx < s.size(); idx++){
-		if (s[idx] <= 47 || 58 <= s[idx]) return;
+// Numbers whose digits fit into the mantissa of T, scaled by a power of ten that T holds exactly,
+// are converted with a single multiplication or division, which rounds correctly
+// that covers what exporters write, anything else goes through std::from_chars
+template <class T>
+bool scan_float(const char*& pos, const char* end, T& value){
+	constexpr T powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	constexpr int max_power = std::is_same_v<T, float> ? 10 : 22;
+	constexpr std::uint64_t max_mantissa = std::uint64_t(1) << std::numeric_limits<T>::digits;
+
+	pos = skip_ws(pos, end);
+	// from_chars takes no leading plus
+	if (pos < end && *pos == '+') pos++;
+	const char* p = pos;
+	const bool negative = p < end && *p == '-';
+	if (negative) p++;
+	std::uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	for (; p < end && is_digit(*p); p++, digits++)
+		mantissa = mantissa * 10 + (*p - '0');
+	if (p < end && *p == '.') {
+		for (p++; p < end && is_digit(*p); p++, digits++, exponent--)
+			mantissa = mantissa * 10 + (*p - '0');
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* e = p + 1;
+		const bool negative_exponent = e < end && *e == '-';
+		if (e < end && (*e == '-' || *e == '+')) e++;
+		int written = 0;
+		// Large exponents only need to stay large, they fall back below
+		for (; e < end && is_digit(*e); e++)
+			written = std::min(written * 10 + (*e - '0'), 1000);
+		if (is_digit(e[-1])) {
+			exponent += negative_exponent ? -written : written;
+			p = e;
+		}
+	}
+	if (digits == 0 || digits > 19 || mantissa > max_mantissa || exponent < -max_power || exponent > max_power) {
+		auto [next, error] = std::from_chars(pos, end, value);
+		if (error != std::errc()) return false;
+		pos = next;
+		return true;
 	}
-	idx++;
-	return;
+	value = exponent < 0 ? T(mantissa) / powers_of_ten[-exponent] : T(mantissa) * powers_of_ten[exponent];
+	if (negative) value = -value;
+	pos = p;
+	return true;
 }
 
-void v(std::string& line, Model* mdl){
-	// Skips the "v" part
-	unsigned int idx = 1;
-	vec3 vertex_position;
-	skip_ws(line, idx);
-	vertex_position.x = std::stof(line.substr(idx));
-
-	skip_to_ws(line, idx);
-	skip_ws(line, idx);
-	vertex_position.y = std::stof(line.substr(idx));
-
-	skip_to_ws(line, idx);
-	skip_ws(line, idx);
-	vertex_position.z = std::stof(line.substr(idx));
+bool scan_int(const char*& pos, const char* end, int& value){
+	const char* p = pos;
+	const bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) p++;
+	const char* digits = p;
+	std::int64_t magnitude = 0;
+	for (; p < end && is_digit(*p) && magnitude <= std::numeric_limits<int>::max(); p++)
+		magnitude = magnitude * 10 + (*p - '0');
+	if (p == digits || magnitude > std::numeric_limits<int>::max()) return false;
+	value = negative ? -magnitude : magnitude;
+	pos = p;
+	return true;
+}
 
+template <class T>
+bool v(const char* pos, const char* end, BasicModel<T>* mdl){
+	vec<3,T> vertex_position;
+	// An optional w and vertex colors may follow, they are not used
+	if (!scan_float(pos, end, vertex_position.x)
+		|| !scan_float(pos, end, vertex_position.y)
+		|| !scan_float(pos, end, vertex_position.z)) return false;
 	mdl->verts.push_back(vertex_position);
+	return true;
 }
 
-void vt(std::string& line, Model* mdl){
-	// Skips the "vt" part
-	unsigned int idx = 2;
-	vec3 vertex_uv;
-	skip_ws(line, idx);
-	vertex_uv.x = std::stof(line.substr(idx));
-
-	skip_ws(line, idx);
-	skip_to_ws(line, idx);
-	vertex_uv.y = std::stof(line.substr(idx));
-
+template <class T>
+bool vt(const char* pos, const char* end, BasicModel<T>* mdl){
+	vec<3,T> vertex_uv;
+	// v is optional and 0 by default, w is not used
+	if (!scan_float(pos, end, vertex_uv.x)) return false;
+	scan_float(pos, end, vertex_uv.y);
 	mdl->tex_coords.push_back(vertex_uv);
+	return true;
 }
 
-void vn(std::string& line, Model* mdl){
-	// Skips the "vn" part
-	unsigned int idx = 2;
-	vec3 vertex_normal;
-	skip_ws(line, idx);
-	vertex_normal.x = std::stof(line.substr(idx));
-
-	skip_to_ws(line, idx);
-	skip_ws(line, idx);
-	vertex_normal.y = std::stof(line.substr(idx));
-
-	skip_to_ws(line, idx);
-	skip_ws(line, idx);
-	vertex_normal.z = std::stof(line.substr(idx));
-
+template <class T>
+bool vn(const char* pos, const char* end, BasicModel<T>* mdl){
+	vec<3,T> vertex_normal;
+	if (!scan_float(pos, end, vertex_normal.x)
+		|| !scan_float(pos, end, vertex_normal.y)
+		|| !scan_float(pos, end, vertex_normal.z)) return false;
 	// Making the length of the vector equal to 1
 	mdl->normals.push_back(vertex_normal/vertex_normal.norm());
+	return true;
 }
 
-void f(std::string& line, Model* mdl){
-	// Skips the "f" part
-	unsigned int idx = 1;
-
-	skip_ws(line, idx);
-	mdl->face_vrtx.push_back(
-		std::stoi(line.substr(idx)) - 1);
-	skip_num(line, idx);
-	if (line[idx] == '/') {
-		if (is_num(line[idx+1])) {
-			idx++;
-			mdl->face_tex.push_back(
-				std::stoi(line.substr(idx)) - 1);
-			skip_num(line, idx);
-		} else {
-			idx++;
+// Index of an "f" corner, 0-based, a negative one in the text counts back from the "count" elements parsed so far
+// which makes it relative, 0 is not an index
+// final_count tells that nothing was parsed before the count, a relative index reaching past the start is refused then,
+// otherwise it is left negative for stitch_chunks
+static bool resolve_index(int index, std::size_t count, bool final_count, int& resolved, bool& relative){
+	if (index == 0) return false;
+	resolved = index > 0 ? index - 1 : (int)count + index;
+	relative = index < 0;
+	return !(relative && final_count && resolved < 0);
+}
+
+// Corner of a face, position, texture coordinate and normal, MISSING_INDEX for the absent attributes
+struct FaceCorner {
+	int index[3] = { MISSING_INDEX, MISSING_INDEX, MISSING_INDEX };
+	bool relative[3] = {};
+};
+
+// Parses "v", "v/vt", "v//vn" or "v/vt/vn"
+template <class T>
+static bool scan_corner(const char*& pos, const char* end, const BasicModel<T>* mdl, bool final_count, FaceCorner& corner){
+	const std::size_t counts[3] = { mdl->verts.size(), mdl->tex_coords.size(), mdl->normals.size() };
+	for (int attribute = 0; attribute < 3; attribute++) {
+		int index;
+		if (attribute > 0) {
+			if (pos == end || *pos != '/') break;
+			pos++;
+			if (!scan_int(pos, end, index)) continue; // "v//vn" or a trailing '/'
+		} else if (!scan_int(pos, end, index)) {
+			return false;
 		}
-		if (line[idx] == '/') {
-			idx++;
-		if (is_num(line[idx])) {
-				mdl->face_norm.push_back(
-				std::stoi(line.substr(idx)) - 1);
-				skip_num(line, idx);
-			}
+		if (!resolve_index(index, counts[attribute], final_count, corner.index[attribute], corner.relative[attribute])) return false;
+	}
+	return true;
+}
+
+template <class T>
+static void push_corner(const FaceCorner& corner, BasicModel<T>* mdl, ObjRelativeIndices* relative){
+	std::vector<int>* const indices[3] = { &mdl->face_vrtx, &mdl->face_tex, &mdl->face_norm };
+	for (int attribute = 0; attribute < 3; attribute++) {
+		if (relative && corner.relative[attribute]) {
+			std::vector<std::size_t>* const positions[3] = { &relative->vrtx, &relative->tex, &relative->norm };
+			positions[attribute]->push_back(indices[attribute]->size());
 		}
+		indices[attribute]->push_back(corner.index[attribute]);
 	}
+}
 
-	skip_ws(line, idx);
-	mdl->face_vrtx.push_back(
-		std::stoi(line.substr(idx)) - 1);
-	skip_num(line, idx);
-	if (line[idx] == '/') {
-		if (is_num(line[idx+1])) {
-			idx++;
-			mdl->face_tex.push_back(
-				std::stoi(line.substr(idx)) - 1);
-			skip_num(line, idx);
-		} else {
-			idx++;
+template <class T>
+bool f(const char* pos, const char* end, BasicModel<T>* mdl, ObjRelativeIndices* relative){
+	// Polygons are fanned around their first corner, the corners after the third add a triangle each
+	const std::size_t size = mdl->face_vrtx.size();
+	FaceCorner first, previous, corner;
+	int corners = 0;
+	bool valid = true;
+	for (pos = skip_ws(pos, end); pos < end; pos = skip_ws(pos, end), corners++) {
+		// Without relative the text is parsed whole and the counts are the final ones
+		if (!scan_corner(pos, end, mdl, !relative, corner)) {
+			valid = false;
+			break;
 		}
-		if (line[idx] == '/') {
-			idx++;
-		if (is_num(line[idx])) {
-				mdl->face_norm.push_back(
-				std::stoi(line.substr(idx)) - 1);
-				skip_num(line, idx);
-			}
+		if (corners >= 3) {
+			push_corner(first, mdl, relative);
+			push_corner(previous, mdl, relative);
 		}
+		if (corners == 0) first = corner;
+		push_corner(corner, mdl, relative);
+		previous = corner;
 	}
-
-	skip_ws(line, idx);
-	mdl->face_vrtx.push_back(
-		std::stoi(line.substr(idx)) - 1);
-	skip_num(line, idx);
-	if (line[idx] == '/') {
-		if (idx + 1 < line.size() && is_num(line[idx+1])) {
-			idx++;
-			mdl->face_tex.push_back(
-				std::stoi(line.substr(idx)) - 1);
-			skip_num(line, idx);
-		} else if (idx + 1 < line.size()) {
-			idx++;
-		} else {}
-		if (line[idx] == '/') {
-			idx++;
-		if (is_num(line[idx])) {
-				mdl->face_norm.push_back(
-				std::stoi(line.substr(idx)) - 1);
-				skip_num(line, idx);
-			}
+	if (valid && corners >= 3) return true;
+	// Takes back the corners of a malformed face, so that the face arrays stay whole triangles
+	mdl->face_vrtx.resize(size);
+	mdl->face_tex.resize(size);
+	mdl->face_norm.resize(size);
+	if (relative) {
+		for (std::vector<std::size_t>* positions : { &relative->vrtx, &relative->tex, &relative->norm }) {
+			while (!positions->empty() && positions->back() >= size) positions->pop_back();
 		}
 	}
+	return false;
 }
 
 } // namespace ObjParser
 
-int parse_obj(std::string filepath, Model* mdl){
-	std::ifstream file;
-	std::string line;
-	std::string line_state;
-	file.open(filepath, std::ios::in);
+ObjCounts count_obj_statements(const char* data, std::size_t size){
+	ObjCounts counts;
+	const char* pos = data;
+	const char* const file_end = data + size;
+	while (pos < file_end) {
+		const char* end = (const char*)std::memchr(pos, '\n', file_end - pos);
+		if (!end) end = file_end;
+		const char* keyword = ObjParser::skip_ws(pos, end);
+		const std::size_t length = ObjParser::skip_to_ws(keyword, end) - keyword;
+		if (length == 1 && keyword[0] == 'v') counts.verts++;
+		else if (length == 2 && keyword[0] == 'v' && keyword[1] == 't') counts.tex_coords++;
+		else if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n') counts.normals++;
+		else if (length == 1 && keyword[0] == 'f') counts.faces++;
+		pos = end + 1;
+	}
+	return counts;
+}
 
-	if(!file.is_open()){
-		std::cerr << "PARSER: Problem parsing the .obj file: could not open" << '\n';
-		return -1;
-	} 
-
-	while (!file.eof()) {
-		std::getline(file, line, '\n');
-		line_state = line.substr(0, 2);
-		if (line_state == "v "){
-			ObjParser::v(line, mdl);
-			continue;
+template <class T>
+ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<T>* mdl, ObjRelativeIndices* relative){
+	// Counting the statements first is a lot cheaper than growing the arrays while parsing
+	const ObjCounts counts = count_obj_statements(data, size);
+	mdl->verts.reserve(mdl->verts.size() + counts.verts);
+	mdl->tex_coords.reserve(mdl->tex_coords.size() + counts.tex_coords);
+	mdl->normals.reserve(mdl->normals.size() + counts.normals);
+	mdl->face_vrtx.reserve(mdl->face_vrtx.size() + 3 * counts.faces);
+	mdl->face_tex.reserve(mdl->face_tex.size() + 3 * counts.faces);
+	mdl->face_norm.reserve(mdl->face_norm.size() + 3 * counts.faces);
+
+	ObjResult result;
+	const char* pos = data;
+	const char* const file_end = data + size;
+	for (std::size_t line = 1; pos < file_end; line++) {
+		result.lines = line;
+		const char* end = (const char*)std::memchr(pos, '\n', file_end - pos);
+		if (!end) end = file_end;
+		const char* keyword = ObjParser::skip_ws(pos, end);
+		const char* args = ObjParser::skip_to_ws(keyword, end);
+		const std::size_t length = args - keyword;
+		ObjError error = ObjError::none;
+		if (length == 1 && keyword[0] == 'v') {
+			if (!ObjParser::v(args, end, mdl)) error = ObjError::bad_vertex;
+		} else if (length == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+			if (!ObjParser::vt(args, end, mdl)) error = ObjError::bad_tex_coord;
+		} else if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+			if (!ObjParser::vn(args, end, mdl)) error = ObjError::bad_normal;
+		} else if (length == 1 && keyword[0] == 'f') {
+			if (!ObjParser::f(args, end, mdl, relative)) error = ObjError::bad_face;
+		} else {
+			result.ignored_lines++;
+		}
+		if (error != ObjError::none) {
+			result.error = error;
+			result.line = line;
+			return result;
 		}
-		if (line_state == "vt"){
-			ObjParser::vt(line, mdl);
-			continue;
+		pos = end + 1;
+	}
+	return result;
+}
+
+// Line of the "f" statement in the .obj text that made the face corner, counted from the first corner of the text
+// polygons count their fanned triangles, the text has to have parsed up to that statement
+static std::size_t face_corner_line(const char* data, std::size_t size, std::size_t corner){
+	std::size_t corners = 0;
+	const char* pos = data;
+	const char* const file_end = data + size;
+	for (std::size_t line = 1; pos < file_end; line++) {
+		const char* end = (const char*)std::memchr(pos, '\n', file_end - pos);
+		if (!end) end = file_end;
+		const char* keyword = ObjParser::skip_ws(pos, end);
+		const char* args = ObjParser::skip_to_ws(keyword, end);
+		if (args - keyword == 1 && keyword[0] == 'f') {
+			int polygon = 0;
+			for (const char* at = ObjParser::skip_ws(args, end); at < end; at = ObjParser::skip_ws(ObjParser::skip_to_ws(at, end), end))
+				polygon++;
+			corners += 3 * std::max(polygon - 2, 0);
+			if (corner < corners) return line;
 		}
-		if (line_state == "vn"){
-			ObjParser::vn(line, mdl);
-			continue;
+		pos = end + 1;
+	}
+	return 0;
+}
+
+// Index of the first face corner from first_corner on whose position, texture coordinate or normal
+// is not an element of mdl (MISSING_INDEX is allowed for the last two), face_vrtx.size() if there is none
+template <class T>
+static std::size_t first_bad_corner(const BasicModel<T>& mdl, std::size_t first_corner){
+	const auto valid = [](int index, std::size_t count, bool optional) {
+		return (index >= 0 && (std::size_t)index < count) || (optional && index == MISSING_INDEX);
+	};
+	for (std::size_t corner = first_corner; corner < mdl.face_vrtx.size(); corner++) {
+		if (!valid(mdl.face_vrtx[corner], mdl.verts.size(), false)
+			|| !valid(mdl.face_tex[corner], mdl.tex_coords.size(), true)
+			|| !valid(mdl.face_norm[corner], mdl.normals.size(), true)) return corner;
+	}
+	return mdl.face_vrtx.size();
+}
+
+// Appends the first nchunks parts to mdl, in parallel over the parts
+// the relative indices of a part were resolved against it alone, they are shifted by the elements before it
+// returns the first face corner of mdl with a relative index before the first element,
+// which the shift can turn into MISSING_INDEX, face_vrtx.size() if there is none
+template <class T>
+static std::size_t stitch_chunks(std::vector<BasicModel<T>>& parts, const std::vector<ObjRelativeIndices>& relative, int nchunks,
+	BasicModel<T>* mdl, ThreadPool& pool){
+	// Prefix sums of the element counts, the last one are the totals
+	struct Offsets {
+		std::size_t verts, tex_coords, normals, face_vrtx, face_tex, face_norm;
+	};
+	std::vector<Offsets> offsets(nchunks + 1);
+	offsets[0] = { mdl->verts.size(), mdl->tex_coords.size(), mdl->normals.size(),
+		mdl->face_vrtx.size(), mdl->face_tex.size(), mdl->face_norm.size() };
+	for (int chunk = 0; chunk < nchunks; chunk++) {
+		const BasicModel<T>& part = parts[chunk];
+		const Offsets& before = offsets[chunk];
+		offsets[chunk + 1] = { before.verts + part.verts.size(), before.tex_coords + part.tex_coords.size(),
+			before.normals + part.normals.size(), before.face_vrtx + part.face_vrtx.size(),
+			before.face_tex + part.face_tex.size(), before.face_norm + part.face_norm.size() };
+	}
+	const Offsets& total = offsets[nchunks];
+	mdl->verts.resize(total.verts);
+	mdl->tex_coords.resize(total.tex_coords);
+	mdl->normals.resize(total.normals);
+	mdl->face_vrtx.resize(total.face_vrtx);
+	mdl->face_tex.resize(total.face_tex);
+	mdl->face_norm.resize(total.face_norm);
+
+	std::vector<std::size_t> bad_corners(nchunks, total.face_vrtx);
+	pool.parallel_for(nchunks, [&](int chunk, unsigned int) {
+		BasicModel<T>& part = parts[chunk];
+		const Offsets& at = offsets[chunk];
+		const auto shift = [&](std::vector<int>& indices, const std::vector<std::size_t>& positions, std::size_t offset) {
+			for (std::size_t i : positions) {
+				indices[i] += (int)offset;
+				if (indices[i] < 0) bad_corners[chunk] = std::min(bad_corners[chunk], at.face_vrtx + i);
+			}
+		};
+		shift(part.face_vrtx, relative[chunk].vrtx, at.verts);
+		shift(part.face_tex, relative[chunk].tex, at.tex_coords);
+		shift(part.face_norm, relative[chunk].norm, at.normals);
+		std::copy(part.verts.begin(), part.verts.end(), mdl->verts.begin() + at.verts);
+		std::copy(part.tex_coords.begin(), part.tex_coords.end(), mdl->tex_coords.begin() + at.tex_coords);
+		std::copy(part.normals.begin(), part.normals.end(), mdl->normals.begin() + at.normals);
+		std::copy(part.face_vrtx.begin(), part.face_vrtx.end(), mdl->face_vrtx.begin() + at.face_vrtx);
+		std::copy(part.face_tex.begin(), part.face_tex.end(), mdl->face_tex.begin() + at.face_tex);
+		std::copy(part.face_norm.begin(), part.face_norm.end(), mdl->face_norm.begin() + at.face_norm);
+		part = BasicModel<T>();
+	});
+	return *std::min_element(bad_corners.begin(), bad_corners.end());
+}
+
+template <class T>
+ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<T>* mdl, ThreadPool& pool){
+	const int nchunks = (int)std::clamp<std::size_t>(size / OBJ_MIN_CHUNK_SIZE, 1, pool.size() * OBJ_CHUNKS_PER_THREAD);
+	if (nchunks == 1) return parse_obj_text(data, size, mdl);
+
+	// A chunk ends with the first line break after an even split of the text
+	std::vector<const char*> bounds(nchunks + 1);
+	bounds[0] = data;
+	bounds[nchunks] = data + size;
+	for (int chunk = 1; chunk < nchunks; chunk++) {
+		const char* split = std::max(data + size / nchunks * chunk, bounds[chunk - 1]);
+		const char* line_break = (const char*)std::memchr(split, '\n', data + size - split);
+		bounds[chunk] = line_break ? line_break + 1 : data + size;
+	}
+
+	const std::size_t first_corner = mdl->face_vrtx.size();
+	std::vector<BasicModel<T>> parts(nchunks);
+	std::vector<ObjRelativeIndices> relative(nchunks);
+	std::vector<ObjResult> results(nchunks);
+	pool.parallel_for(nchunks, [&](int chunk, unsigned int) {
+		results[chunk] = parse_obj_text(bounds[chunk], bounds[chunk + 1] - bounds[chunk], &parts[chunk], &relative[chunk]);
+	});
+
+	// Like the serial parse, mdl keeps everything before the first error
+	ObjResult result;
+	int parsed = 0;
+	while (parsed < nchunks) {
+		const ObjResult& part = results[parsed++];
+		result.ignored_lines += part.ignored_lines;
+		if (!part) {
+			result.error = part.error;
+			result.line = result.lines + part.line;
+			result.lines = result.line;
+			break;
 		}
-		if (line_state == "f "){
-			ObjParser::f(line, mdl);
-			continue;
+		result.lines += part.lines;
+	}
+	const std::size_t bad_corner = stitch_chunks(parts, relative, parsed, mdl, pool);
+	if (bad_corner < mdl->face_vrtx.size()) {
+		// Reported like the serial parse does, unless a malformed line comes first
+		const std::size_t line = face_corner_line(data, size, bad_corner - first_corner);
+		if (result || line < result.line) {
+			result.error = ObjError::bad_face;
+			result.line = line;
 		}
-		std::cout << "PARSER: Weird line encountered [" << line << "]\n";
+	}
+	return result;
+}
+
+// Both load_obj, the text is parsed on the pool if there is one
+template <class T>
+static ObjResult load_obj(const std::string& filepath, BasicModel<T>* mdl, ThreadPool* pool){
+	MappedFile file(filepath);
+	if (!file.is_open()) {
+		ObjResult result;
+		result.error = ObjError::cannot_open;
+		return result;
+	}
+	const std::size_t first_corner = mdl->face_vrtx.size();
+	ObjResult result = pool ? parse_obj_text(file.data(), file.size(), mdl, *pool)
+		: parse_obj_text(file.data(), file.size(), mdl);
+	// Indices past the end can only be told once everything is parsed
+	const std::size_t bad_corner = result ? first_bad_corner(*mdl, first_corner) : mdl->face_vrtx.size();
+	if (bad_corner < mdl->face_vrtx.size()) {
+		result.error = ObjError::bad_face;
+		result.line = face_corner_line(file.data(), file.size(), bad_corner - first_corner);
+	}
+	if (result) {
+		mdl->fill_missing_attributes();
+		mdl->compute_tangents();
+		mdl->build_vertex_index();
+	}
+	return result;
+}
+
+// Prints the error of a load_obj, returns -1 on one and 0 otherwise
+static int report_obj_result(const std::string& filepath, const ObjResult& result){
+	if (!result) {
+		std::cerr << "PARSER: Problem parsing the .obj file " << filepath << ": " << obj_error_message(result.error);
+		if (result.line) std::cerr << " on line " << result.line;
+		std::cerr << '\n';
+		return -1;
 	}
 	return 0;
 }
+
+template <class T>
+ObjResult load_obj(const std::string& filepath, BasicModel<T>* mdl){
+	return load_obj(filepath, mdl, (ThreadPool*)nullptr);
+}
+
+template <class T>
+ObjResult load_obj(const std::string& filepath, BasicModel<T>* mdl, ThreadPool& pool){
+	return load_obj(filepath, mdl, &pool);
+}
+
+// Both parse_obj, a fresh mesh cache is loaded instead of the .obj, which is cached after a parse
+template <class T>
+static int parse_obj(const std::string& filepath, BasicModel<T>* mdl, ThreadPool* pool){
+	if (load_mesh_cache(filepath, mdl)) return 0;
+	if (report_obj_result(filepath, load_obj(filepath, mdl, pool)) == -1) return -1;
+	write_mesh_cache(filepath, *mdl);
+	return 0;
+}
+
+template <class T>
+int parse_obj(std::string filepath, BasicModel<T>* mdl){
+	return parse_obj(filepath, mdl, (ThreadPool*)nullptr);
+}
+
+template <class T>
+int parse_obj(std::string filepath, BasicModel<T>* mdl, ThreadPool& pool){
+	return parse_obj(filepath, mdl, &pool);
+}
+
+template ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<double>* mdl, ObjRelativeIndices* relative);
+template ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<float>* mdl, ObjRelativeIndices* relative);
+template ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<double>* mdl, ThreadPool& pool);
+template ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<float>* mdl, ThreadPool& pool);
+template ObjResult load_obj(const std::string& filepath, BasicModel<double>* mdl);
+template ObjResult load_obj(const std::string& filepath, BasicModel<float>* mdl);
+template ObjResult load_obj(const std::string& filepath, BasicModel<double>* mdl, ThreadPool& pool);
+template ObjResult load_obj(const std::string& filepath, BasicModel<float>* mdl, ThreadPool& pool);
+template int parse_obj(std::string filepath, BasicModel<double>* mdl);
+template int parse_obj(std::string filepath, BasicModel<float>* mdl);
+template int parse_obj(std::string filepath, BasicModel<double>* mdl, ThreadPool& pool);
+template int parse_obj(std::string filepath, BasicModel<float>* mdl, ThreadPool& pool);
@@ -1,22 +1,106 @@
 #pragma once
-#include <fstream>
-#include <iostream>
+#include <cstddef>
 #include <string>
+#include <vector>
 
 #include "./model.h"
 
+class ThreadPool;
+
+// Parallel parses split the text into up to OBJ_CHUNKS_PER_THREAD chunks per thread, of at least OBJ_MIN_CHUNK_SIZE bytes
+constexpr std::size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
+constexpr unsigned int OBJ_CHUNKS_PER_THREAD = 4;
+
+// Why a parse stopped, the line of the ObjResult tells where
+enum class ObjError {
+	none,
+	cannot_open, // The file could not be opened or mapped
+	bad_vertex, // "v" without three numbers
+	bad_tex_coord, // "vt" without a number
+	bad_normal, // "vn" without three numbers
+	bad_face, // "f" with less than three corners, a malformed one, an index of 0 or one out of range
+};
+
+// Outcome of parsing an .obj file
+struct ObjResult {
+	ObjError error = ObjError::none;
+	std::size_t line = 0; // 1-based line of the error, 0 without one
+	std::size_t lines = 0; // Lines parsed, up to the one of the error
+	std::size_t ignored_lines = 0; // Comments, empty lines and statements the parser does not use (g, s, usemtl, ...)
+
+	explicit operator bool() const { return error == ObjError::none; }
+};
+
+// Readable description of an ObjError
+const char* obj_error_message(ObjError error);
+
+// Positions in face_vrtx, face_tex and face_norm of the indices that were negative in the text
+// they were resolved against the elements parsed so far, which is why a chunk parsed on its own needs them
+struct ObjRelativeIndices {
+	std::vector<std::size_t> vrtx;
+	std::vector<std::size_t> tex;
+	std::vector<std::size_t> norm;
+};
+
 namespace ObjParser {
-	constexpr bool is_num(const char c);
-
-	void skip_ws(const std::string& s, unsigned int& idx);
-	void skip_to_ws(const std::string& s, unsigned int& idx);
-	void skip_to_fs(const std::string& s, unsigned int& idx);
-	void skip_num(const std::string& s, unsigned int& idx);
-	
-	void v(std::string& line, Model* mdl);
-	void vt(std::string& line, Model* mdl);
-	void vn(std::string& line, Model* mdl);
-	void f(std::string& line, Model* mdl);
+	// The parser works in place on the text, lines are [pos, end) ranges without the line break
+
+	const char* skip_ws(const char* pos, const char* end);
+	const char* skip_to_ws(const char* pos, const char* end);
+
+	// Both advance pos past the number and return false if there is none
+	template <class T> bool scan_float(const char*& pos, const char* end, T& value);
+	bool scan_int(const char*& pos, const char* end, int& value);
+
+	// Each parses the rest of the line after its keyword
+	template <class T> bool v(const char* pos, const char* end, BasicModel<T>* mdl);
+	template <class T> bool vt(const char* pos, const char* end, BasicModel<T>* mdl);
+	template <class T> bool vn(const char* pos, const char* end, BasicModel<T>* mdl);
+	// Faces with more than three corners are fanned into triangles around the first one
+	// corners without a texture coordinate or a normal get MISSING_INDEX in face_tex or face_norm,
+	// negative indices count back from the last element, see ObjRelativeIndices
+	template <class T> bool f(const char* pos, const char* end, BasicModel<T>* mdl, ObjRelativeIndices* relative);
 }
 
-int parse_obj(std::string filepath, Model* mdl);
+// Number of "v", "vt", "vn" and "f" lines of an .obj text
+struct ObjCounts {
+	std::size_t verts = 0;
+	std::size_t tex_coords = 0;
+	std::size_t normals = 0;
+	std::size_t faces = 0;
+};
+
+ObjCounts count_obj_statements(const char* data, std::size_t size);
+
+// Parses the .obj text in [data, data + size) into mdl, appending to what it holds
+// stops at the first malformed line, nothing is allocated per line
+// the positions of negative face indices are recorded in relative if it is given,
+// otherwise the ones that reach before the first element are malformed
+// indices past the last element are only refused by load_obj, a face may come before its vertices
+// Defined for BasicModel<double> and BasicModel<float>
+template <class T>
+ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<T>* mdl, ObjRelativeIndices* relative = nullptr);
+
+// parse_obj_text on the threads of the pool, the text is split into chunks at line breaks,
+// every chunk is parsed into a model of its own and the models are concatenated into mdl
+// mdl and the result end up the same as with the serial parse, texts below two chunks are parsed serially
+template <class T>
+ObjResult parse_obj_text(const char* data, std::size_t size, BasicModel<T>* mdl, ThreadPool& pool);
+
+// Maps the file into memory and parses it in place, checks that every face index is an element of mdl
+// (bad_face on the line of the face otherwise), then fills the missing attributes
+// and computes the tangents and the vertex index
+// Defined for BasicModel<double> and BasicModel<float>
+template <class T>
+ObjResult load_obj(const std::string& filepath, BasicModel<T>* mdl);
+template <class T>
+ObjResult load_obj(const std::string& filepath, BasicModel<T>* mdl, ThreadPool& pool);
+
+// load_obj that reports errors on std::cerr and returns -1 on them, 0 otherwise
+// goes through the mesh cache: a fresh one replaces the arrays of mdl without parsing,
+// otherwise the .obj is parsed and the cache (re)written next to it, see "mesh_cache.h"
+// Defined for BasicModel<double> and BasicModel<float>
+template <class T>
+int parse_obj(std::string filepath, BasicModel<T>* mdl);
+template <class T>
+int parse_obj(std::string filepath, BasicModel<T>* mdl, ThreadPool& pool);
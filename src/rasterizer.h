@@ -0,0 +1,595 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+#include "mat_vec.h"
+
+// SIMD quad kernels are built with per-function target attributes
+// and picked at runtime, so the binary itself needs no -mavx
+#if defined(__GNUC__) && defined(__SSE2__)
+#define RASTERIZER_SIMD
+#include <immintrin.h>
+#endif
+
+// Vertices are snapped to 1/256 of a pixel before the edge setup
+// this keeps every edge value an exact integer (in a double) for coordinates
+// up to ~2^18 pixels, so stepping gives the same result no matter where it starts
+constexpr int SUBPIXEL_BITS = 8;
+constexpr double SUBPIXEL_STEPS = 1 << SUBPIXEL_BITS;
+
+// Most samples per pixel of the multisampled rasterization
+constexpr int MAX_SAMPLES = 8;
+// Sample positions lie strictly closer than this to the pixel center on both axes
+constexpr double SAMPLE_REACH = 0.5;
+
+// Sample positions of the multisampled rasterization in 1/16 pixels from the pixel center,
+// the usual 2x/4x/8x GPU patterns, no two samples share a row or a column
+// so near-horizontal and near-vertical edges get as many steps as there are samples
+// 1/16 pixels are whole subpixels, so the edge values at the samples stay exact
+struct SamplePattern {
+	int count;
+	int x[MAX_SAMPLES];
+	int y[MAX_SAMPLES];
+};
+
+// Pattern with "samples" samples, nullptr if there is none
+inline const SamplePattern* sample_pattern(int samples)
+{
+	static const SamplePattern patterns[] = {
+		{ 1, { 0 }, { 0 } },
+		{ 2, { 4, -4 }, { 4, -4 } },
+		{ 4, { -2, 6, -6, 2 }, { -6, -2, 2, 6 } },
+		{ 8, { 1, -1, 5, -3, -5, -7, 3, 7 }, { -3, 3, 1, -5, 5, -1, 7, -7 } },
+	};
+	for (const SamplePattern& pattern : patterns) {
+		if (pattern.count == samples)
+			return &pattern;
+	}
+	return nullptr;
+}
+
+// Edge functions of a screen space triangle, they are set up once per triangle
+// E_i(P) = A_i*P.x + B_i*P.y + C_i is twice the signed area of the triangle
+// formed by P and the edge opposite to the vertex i (in subpixel units),
+// which makes E_i(P)/area the i-th barycentric coordinate of P
+struct TriangleEdges {
+	double A[3];
+	double B[3];
+	double C[3];
+	// Twice the area of the triangle, edges are oriented so that it is positive
+	double area;
+	double inv_area;
+	// Top-left fill rule: a pixel lying exactly on an edge
+	// belongs to the triangle only if that edge is a top or a left one
+	bool top_left[3];
+	// bbox[0] is the inner point
+	// bbox[1] is the outer point
+	// both are clamped to the canvas
+	vec2i bbox[2];
+	// 1/w of the vertices in clip space, taken from the w of the vertices handed to the setup
+	double rhw[3];
+	// Whether the quad barycentrics are perspective-corrected with rhw,
+	// the setup leaves it off, see assemble_triangle
+	bool perspective;
+};
+
+// Winding of the triangles dropped by the primitive assembly, as they appear
+// on the screen (y axis pointing down), none keeps both sides
+// meshes with counter-clockwise front faces stay counter-clockwise
+// through the viewport flip, so their back faces are culled with cw
+enum class CullMode { none, cw, ccw };
+
+// Outcome of the primitive assembly of a triangle
+enum class TriangleSetup {
+	visible,
+	culled, // Facing away according to the CullMode
+	degenerate, // Zero area after the subpixel snapping, or not finite
+	offscreen, // Bounding box misses every pixel center of the canvas
+};
+
+// Primitive assembly: trivially rejects the triangles that cannot produce a pixel,
+// the cheap tests go first, so rejected triangles never reach the edge setup
+// otherwise fills the edge equations and the bounding box of the triangle
+// sample_reach widens the bounding box to the pixels whose samples (rather than centers)
+// the triangle may cover, SAMPLE_REACH for the multisampled rasterization
+template <class vec_T>
+TriangleSetup setup_triangle_edges(const std::array<vec_T, 3>& vertices, int width, int height, TriangleEdges& edges,
+	CullMode cull, double sample_reach = 0)
+{
+	double X[3];
+	double Y[3];
+	for (int i = 0; i < 3; i++) {
+		X[i] = std::round(vertices[i].x * SUBPIXEL_STEPS);
+		Y[i] = std::round(vertices[i].y * SUBPIXEL_STEPS);
+	}
+
+	// Twice the signed area, positive for triangles that appear clockwise on the screen
+	// also catches non-finite vertices before they reach the bounding box
+	const double area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+	if (area == 0 || !std::isfinite(area))
+		return TriangleSetup::degenerate;
+
+	double xmin = std::min({ X[0], X[1], X[2] }) / SUBPIXEL_STEPS - sample_reach;
+	double ymin = std::min({ Y[0], Y[1], Y[2] }) / SUBPIXEL_STEPS - sample_reach;
+	double xmax = std::max({ X[0], X[1], X[2] }) / SUBPIXEL_STEPS + sample_reach;
+	double ymax = std::max({ Y[0], Y[1], Y[2] }) / SUBPIXEL_STEPS + sample_reach;
+	// Pixels are sampled at integer coordinates
+	edges.bbox[0].x = (int)std::clamp(std::ceil(xmin), 0.0, (double)width);
+	edges.bbox[0].y = (int)std::clamp(std::ceil(ymin), 0.0, (double)height);
+	edges.bbox[1].x = (int)std::clamp(std::floor(xmax), -1.0, (double)width - 1);
+	edges.bbox[1].y = (int)std::clamp(std::floor(ymax), -1.0, (double)height - 1);
+	if (edges.bbox[0].x > edges.bbox[1].x || edges.bbox[0].y > edges.bbox[1].y)
+		return TriangleSetup::offscreen;
+	if ((cull == CullMode::cw && area > 0) || (cull == CullMode::ccw && area < 0))
+		return TriangleSetup::culled;
+
+	for (int i = 0; i < 3; i++) {
+		// Edge i goes from the vertex j to the vertex k
+		const int j = (i + 1) % 3;
+		const int k = (i + 2) % 3;
+		edges.A[i] = Y[j] - Y[k];
+		edges.B[i] = X[k] - X[j];
+		edges.C[i] = -(edges.A[i] * X[k] + edges.B[i] * Y[k]);
+	}
+	edges.area = edges.A[0] * X[0] + edges.B[0] * Y[0] + edges.C[0];
+
+	// Flipping clockwise triangles so that the inside is always positive
+	if (edges.area < 0) {
+		for (int i = 0; i < 3; i++) {
+			edges.A[i] = -edges.A[i];
+			edges.B[i] = -edges.B[i];
+			edges.C[i] = -edges.C[i];
+		}
+		edges.area = -edges.area;
+	}
+	edges.inv_area = 1.0 / edges.area;
+
+	// (A, B) is the inward normal of the edge, y axis points down on the screen
+	// left edge: the inside is to the right of it
+	// top edge: horizontal with the inside below it
+	for (int i = 0; i < 3; i++) {
+		edges.top_left[i] = (edges.A[i] > 0) || (edges.A[i] == 0 && edges.B[i] > 0);
+		edges.rhw[i] = vertices[i].w;
+	}
+	edges.perspective = false;
+	return TriangleSetup::visible;
+}
+
+// Fills the edge equations and the bounding box of the triangle without culling
+// returns false if there is nothing to rasterize (degenerate or off-screen)
+template <class vec_T>
+bool setup_triangle_edges(const std::array<vec_T, 3>& vertices, int width, int height, TriangleEdges& edges)
+{
+	return setup_triangle_edges(vertices, width, height, edges, CullMode::none) == TriangleSetup::visible;
+}
+
+// Walks the part of the bounding box that lies inside [rect_min, rect_max]
+// stepping the edge functions incrementally
+// and calls fragment_fn(x, y, barycentric) for every covered pixel
+template <class Fn>
+void rasterize_edges(const TriangleEdges& edges, vec2i rect_min, vec2i rect_max, Fn&& fragment_fn)
+{
+	const int xbegin = std::max(edges.bbox[0].x, rect_min.x);
+	const int ybegin = std::max(edges.bbox[0].y, rect_min.y);
+	const int xend = std::min(edges.bbox[1].x, rect_max.x);
+	const int yend = std::min(edges.bbox[1].y, rect_max.y);
+
+	const double x0 = xbegin * SUBPIXEL_STEPS;
+	const double step[3] = { edges.A[0] * SUBPIXEL_STEPS, edges.A[1] * SUBPIXEL_STEPS, edges.A[2] * SUBPIXEL_STEPS };
+	for (int y = ybegin; y <= yend; y++) {
+		const double y0 = y * SUBPIXEL_STEPS;
+		double w0 = edges.A[0] * x0 + edges.B[0] * y0 + edges.C[0];
+		double w1 = edges.A[1] * x0 + edges.B[1] * y0 + edges.C[1];
+		double w2 = edges.A[2] * x0 + edges.B[2] * y0 + edges.C[2];
+		for (int x = xbegin; x <= xend; x++) {
+			bool inside = (w0 > 0 || (w0 == 0 && edges.top_left[0]))
+				&& (w1 > 0 || (w1 == 0 && edges.top_left[1]))
+				&& (w2 > 0 || (w2 == 0 && edges.top_left[2]));
+			if (inside) {
+				fragment_fn(x, y, vec3 { w0 * edges.inv_area, w1 * edges.inv_area, w2 * edges.inv_area });
+			}
+			w0 += step[0];
+			w1 += step[1];
+			w2 += step[2];
+		}
+	}
+}
+
+// Walks the bounding box of the triangle stepping the edge functions incrementally
+// and calls fragment_fn(x, y, barycentric) for every covered pixel
+template <class vec_T, class Fn>
+void rasterize_triangle(const std::array<vec_T, 3>& vertices, int width, int height, Fn&& fragment_fn)
+{
+	TriangleEdges edges;
+	if (!setup_triangle_edges(vertices, width, height, edges))
+		return;
+	rasterize_edges(edges, edges.bbox[0], edges.bbox[1], fragment_fn);
+}
+
+// 2x2 block of pixels, the lanes are (x, y), (x+1, y), (x, y+1), (x+1, y+1)
+// barycentrics and depth are filled for every lane, including the uncovered ones,
+// so that shaders can take screen space differences across the quad
+struct FragmentQuad {
+	int x;
+	int y;
+	// Bit i is set if the lane i is covered by the triangle and is inside the rectangle
+	int mask;
+	// barycentric[i][lane] is the i-th barycentric coordinate of the lane
+	double barycentric[3][4];
+	double z[4];
+
+	vec3 get_barycentric(int lane) const {
+		return vec3 { barycentric[0][lane], barycentric[1][lane], barycentric[2][lane] };
+	}
+};
+
+// Mask of the lanes of the quad at (x, y) that lie inside [rect_min, rect_max]
+inline int quad_rect_mask(int x, int y, vec2i rect_min, vec2i rect_max)
+{
+	int cols = (x >= rect_min.x ? 0b01 : 0) | (x + 1 <= rect_max.x ? 0b10 : 0);
+	int rows = (y >= rect_min.y ? 0b01 : 0) | (y + 1 <= rect_max.y ? 0b10 : 0);
+	return ((rows & 0b01) ? cols : 0) | ((rows & 0b10) ? cols << 2 : 0);
+}
+
+// Edge values are exact integers, so the top-left rule "w > 0 || (w == 0 && top_left)"
+// turns into a single comparison against this threshold
+inline double top_left_threshold(const TriangleEdges& edges, int i)
+{
+	return edges.top_left[i] ? 0.0 : 1.0;
+}
+
+// Portable version of the quad walk, used when no SIMD kernel is available
+template <class Fn>
+void rasterize_quads_scalar(const TriangleEdges& edges, vec3 vertex_z, vec2i rect_min, vec2i rect_max, Fn&& quad_fn)
+{
+	const int xbegin = std::max(edges.bbox[0].x, rect_min.x);
+	const int ybegin = std::max(edges.bbox[0].y, rect_min.y);
+	const int xend = std::min(edges.bbox[1].x, rect_max.x);
+	const int yend = std::min(edges.bbox[1].y, rect_max.y);
+	const vec2i clip_min = { .x = xbegin, .y = ybegin };
+	const vec2i clip_max = { .x = xend, .y = yend };
+
+	double offset[3][4];
+	double threshold[3];
+	for (int i = 0; i < 3; i++) {
+		const double a = edges.A[i] * SUBPIXEL_STEPS;
+		const double b = edges.B[i] * SUBPIXEL_STEPS;
+		offset[i][0] = 0;
+		offset[i][1] = a;
+		offset[i][2] = b;
+		offset[i][3] = a + b;
+		threshold[i] = top_left_threshold(edges, i);
+	}
+
+	FragmentQuad quad;
+	const int qxbegin = xbegin & ~1;
+	for (quad.y = ybegin & ~1; quad.y <= yend; quad.y += 2) {
+		double row[3];
+		for (int i = 0; i < 3; i++) {
+			row[i] = edges.A[i] * (qxbegin * SUBPIXEL_STEPS) + edges.B[i] * (quad.y * SUBPIXEL_STEPS) + edges.C[i];
+		}
+		for (quad.x = qxbegin; quad.x <= xend; quad.x += 2) {
+			quad.mask = quad_rect_mask(quad.x, quad.y, clip_min, clip_max);
+			for (int lane = 0; lane < 4; lane++) {
+				const double w0 = row[0] + offset[0][lane];
+				const double w1 = row[1] + offset[1][lane];
+				const double w2 = row[2] + offset[2][lane];
+				if (w0 < threshold[0] || w1 < threshold[1] || w2 < threshold[2])
+					quad.mask &= ~(1 << lane);
+				quad.barycentric[0][lane] = w0 * edges.inv_area;
+				quad.barycentric[1][lane] = w1 * edges.inv_area;
+				quad.barycentric[2][lane] = w2 * edges.inv_area;
+				quad.z[lane] = quad.barycentric[0][lane] * vertex_z.x + quad.barycentric[1][lane] * vertex_z.y
+					+ quad.barycentric[2][lane] * vertex_z.z;
+				if (edges.perspective) {
+					const double q0 = quad.barycentric[0][lane] * edges.rhw[0];
+					const double q1 = quad.barycentric[1][lane] * edges.rhw[1];
+					const double q2 = quad.barycentric[2][lane] * edges.rhw[2];
+					const double w = 1.0 / (q0 + q1 + q2);
+					quad.barycentric[0][lane] = q0 * w;
+					quad.barycentric[1][lane] = q1 * w;
+					quad.barycentric[2][lane] = q2 * w;
+				}
+			}
+			if (quad.mask)
+				quad_fn(quad);
+			for (int i = 0; i < 3; i++) {
+				row[i] += 2 * edges.A[i] * SUBPIXEL_STEPS;
+			}
+		}
+	}
+}
+
+#ifdef RASTERIZER_SIMD
+// SSE2 keeps two lanes per register: the top and the bottom row of the quad
+template <class Fn>
+void rasterize_quads_sse2(const TriangleEdges& edges, vec3 vertex_z, vec2i rect_min, vec2i rect_max, Fn&& quad_fn)
+{
+	const int xbegin = std::max(edges.bbox[0].x, rect_min.x);
+	const int ybegin = std::max(edges.bbox[0].y, rect_min.y);
+	const int xend = std::min(edges.bbox[1].x, rect_max.x);
+	const int yend = std::min(edges.bbox[1].y, rect_max.y);
+	const vec2i clip_min = { .x = xbegin, .y = ybegin };
+	const vec2i clip_max = { .x = xend, .y = yend };
+
+	__m128d offset_top[3];
+	__m128d offset_bottom[3];
+	__m128d threshold[3];
+	for (int i = 0; i < 3; i++) {
+		const double a = edges.A[i] * SUBPIXEL_STEPS;
+		const double b = edges.B[i] * SUBPIXEL_STEPS;
+		offset_top[i] = _mm_set_pd(a, 0);
+		offset_bottom[i] = _mm_set_pd(a + b, b);
+		threshold[i] = _mm_set1_pd(top_left_threshold(edges, i));
+	}
+	const __m128d inv_area = _mm_set1_pd(edges.inv_area);
+	const __m128d z0 = _mm_set1_pd(vertex_z.x);
+	const __m128d z1 = _mm_set1_pd(vertex_z.y);
+	const __m128d z2 = _mm_set1_pd(vertex_z.z);
+	const __m128d rhw[3] = { _mm_set1_pd(edges.rhw[0]), _mm_set1_pd(edges.rhw[1]), _mm_set1_pd(edges.rhw[2]) };
+
+	FragmentQuad quad;
+	const int qxbegin = xbegin & ~1;
+	for (quad.y = ybegin & ~1; quad.y <= yend; quad.y += 2) {
+		double row[3];
+		for (int i = 0; i < 3; i++) {
+			row[i] = edges.A[i] * (qxbegin * SUBPIXEL_STEPS) + edges.B[i] * (quad.y * SUBPIXEL_STEPS) + edges.C[i];
+		}
+		for (quad.x = qxbegin; quad.x <= xend; quad.x += 2) {
+			int covered = 0b1111;
+			__m128d b_top[3];
+			__m128d b_bottom[3];
+			for (int i = 0; i < 3; i++) {
+				const __m128d base = _mm_set1_pd(row[i]);
+				const __m128d w_top = _mm_add_pd(base, offset_top[i]);
+				const __m128d w_bottom = _mm_add_pd(base, offset_bottom[i]);
+				covered &= _mm_movemask_pd(_mm_cmpge_pd(w_top, threshold[i]))
+					| (_mm_movemask_pd(_mm_cmpge_pd(w_bottom, threshold[i])) << 2);
+				b_top[i] = _mm_mul_pd(w_top, inv_area);
+				b_bottom[i] = _mm_mul_pd(w_bottom, inv_area);
+			}
+			_mm_storeu_pd(&quad.z[0],
+				_mm_add_pd(_mm_add_pd(_mm_mul_pd(b_top[0], z0), _mm_mul_pd(b_top[1], z1)), _mm_mul_pd(b_top[2], z2)));
+			_mm_storeu_pd(&quad.z[2],
+				_mm_add_pd(_mm_add_pd(_mm_mul_pd(b_bottom[0], z0), _mm_mul_pd(b_bottom[1], z1)), _mm_mul_pd(b_bottom[2], z2)));
+			if (edges.perspective) {
+				for (int i = 0; i < 3; i++) {
+					b_top[i] = _mm_mul_pd(b_top[i], rhw[i]);
+					b_bottom[i] = _mm_mul_pd(b_bottom[i], rhw[i]);
+				}
+				const __m128d w_top = _mm_div_pd(_mm_set1_pd(1.0), _mm_add_pd(_mm_add_pd(b_top[0], b_top[1]), b_top[2]));
+				const __m128d w_bottom
+					= _mm_div_pd(_mm_set1_pd(1.0), _mm_add_pd(_mm_add_pd(b_bottom[0], b_bottom[1]), b_bottom[2]));
+				for (int i = 0; i < 3; i++) {
+					b_top[i] = _mm_mul_pd(b_top[i], w_top);
+					b_bottom[i] = _mm_mul_pd(b_bottom[i], w_bottom);
+				}
+			}
+			for (int i = 0; i < 3; i++) {
+				_mm_storeu_pd(&quad.barycentric[i][0], b_top[i]);
+				_mm_storeu_pd(&quad.barycentric[i][2], b_bottom[i]);
+			}
+			quad.mask = covered & quad_rect_mask(quad.x, quad.y, clip_min, clip_max);
+			if (quad.mask)
+				quad_fn(quad);
+			for (int i = 0; i < 3; i++) {
+				row[i] += 2 * edges.A[i] * SUBPIXEL_STEPS;
+			}
+		}
+	}
+}
+
+// AVX holds the whole quad in one register
+template <class Fn>
+[[gnu::target("avx")]] void rasterize_quads_avx(const TriangleEdges& edges, vec3 vertex_z, vec2i rect_min, vec2i rect_max, Fn&& quad_fn)
+{
+	const int xbegin = std::max(edges.bbox[0].x, rect_min.x);
+	const int ybegin = std::max(edges.bbox[0].y, rect_min.y);
+	const int xend = std::min(edges.bbox[1].x, rect_max.x);
+	const int yend = std::min(edges.bbox[1].y, rect_max.y);
+	const vec2i clip_min = { .x = xbegin, .y = ybegin };
+	const vec2i clip_max = { .x = xend, .y = yend };
+
+	__m256d offset[3];
+	__m256d threshold[3];
+	for (int i = 0; i < 3; i++) {
+		const double a = edges.A[i] * SUBPIXEL_STEPS;
+		const double b = edges.B[i] * SUBPIXEL_STEPS;
+		offset[i] = _mm256_set_pd(a + b, b, a, 0);
+		threshold[i] = _mm256_set1_pd(top_left_threshold(edges, i));
+	}
+	const __m256d inv_area = _mm256_set1_pd(edges.inv_area);
+	const __m256d z0 = _mm256_set1_pd(vertex_z.x);
+	const __m256d z1 = _mm256_set1_pd(vertex_z.y);
+	const __m256d z2 = _mm256_set1_pd(vertex_z.z);
+	const __m256d rhw[3] = { _mm256_set1_pd(edges.rhw[0]), _mm256_set1_pd(edges.rhw[1]), _mm256_set1_pd(edges.rhw[2]) };
+
+	FragmentQuad quad;
+	const int qxbegin = xbegin & ~1;
+	for (quad.y = ybegin & ~1; quad.y <= yend; quad.y += 2) {
+		double row[3];
+		for (int i = 0; i < 3; i++) {
+			row[i] = edges.A[i] * (qxbegin * SUBPIXEL_STEPS) + edges.B[i] * (quad.y * SUBPIXEL_STEPS) + edges.C[i];
+		}
+		for (quad.x = qxbegin; quad.x <= xend; quad.x += 2) {
+			int covered = 0b1111;
+			__m256d b[3];
+			for (int i = 0; i < 3; i++) {
+				const __m256d w = _mm256_add_pd(_mm256_set1_pd(row[i]), offset[i]);
+				covered &= _mm256_movemask_pd(_mm256_cmp_pd(w, threshold[i], _CMP_GE_OQ));
+				b[i] = _mm256_mul_pd(w, inv_area);
+			}
+			_mm256_storeu_pd(quad.z,
+				_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(b[0], z0), _mm256_mul_pd(b[1], z1)), _mm256_mul_pd(b[2], z2)));
+			if (edges.perspective) {
+				for (int i = 0; i < 3; i++) {
+					b[i] = _mm256_mul_pd(b[i], rhw[i]);
+				}
+				const __m256d w = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_add_pd(_mm256_add_pd(b[0], b[1]), b[2]));
+				for (int i = 0; i < 3; i++) {
+					b[i] = _mm256_mul_pd(b[i], w);
+				}
+			}
+			for (int i = 0; i < 3; i++) {
+				_mm256_storeu_pd(quad.barycentric[i], b[i]);
+			}
+			quad.mask = covered & quad_rect_mask(quad.x, quad.y, clip_min, clip_max);
+			if (quad.mask)
+				quad_fn(quad);
+			for (int i = 0; i < 3; i++) {
+				row[i] += 2 * edges.A[i] * SUBPIXEL_STEPS;
+			}
+		}
+	}
+}
+
+inline bool cpu_has_avx()
+{
+	static const bool has_avx = __builtin_cpu_supports("avx");
+	return has_avx;
+}
+#endif
+
+// Walks the part of the bounding box that lies inside [rect_min, rect_max] in 2x2 quads
+// and calls quad_fn(quad) for every quad with at least one covered pixel
+// vertex_z holds the depth of the vertices, it is interpolated into quad.z linearly,
+// the barycentrics are perspective-corrected if edges.perspective is set:
+// b_i*rhw_i / sum(b_j*rhw_j), with one division per quad
+// The fastest kernel supported by the CPU is picked at runtime,
+// all of them produce exactly the same quads
+template <class Fn>
+void rasterize_quads(const TriangleEdges& edges, vec3 vertex_z, vec2i rect_min, vec2i rect_max, Fn&& quad_fn)
+{
+#ifdef RASTERIZER_SIMD
+	if (cpu_has_avx()) {
+		rasterize_quads_avx(edges, vertex_z, rect_min, rect_max, quad_fn);
+	} else {
+		rasterize_quads_sse2(edges, vertex_z, rect_min, rect_max, quad_fn);
+	}
+#else
+	rasterize_quads_scalar(edges, vertex_z, rect_min, rect_max, quad_fn);
+#endif
+}
+
+// FragmentQuad of the multisampled rasterization, z is still the depth of the pixel centers
+// mask has the lanes with at least one covered sample, the center itself may be outside of the triangle,
+// the barycentrics of such a lane are the ones of its first covered sample (centroid interpolation),
+// so the attributes are never extrapolated past the triangle
+struct MultisampleQuad : FragmentQuad {
+	// Bit s is set if the sample s of the lane is covered
+	int coverage[4];
+	// Depth at every sample of the lane
+	double sample_z[4][MAX_SAMPLES];
+};
+
+// Multisampled counterpart of rasterize_quads, the coverage is tested at every sample of the pattern
+// the bounding box has to be set up with SAMPLE_REACH
+// quad_fn(quad) gets a MultisampleQuad, the barycentrics are perspective-corrected like in rasterize_quads
+template <class Fn>
+void rasterize_multisample_quads(const TriangleEdges& edges, vec3 vertex_z, const SamplePattern& pattern,
+	vec2i rect_min, vec2i rect_max, Fn&& quad_fn)
+{
+	const int xbegin = std::max(edges.bbox[0].x, rect_min.x);
+	const int ybegin = std::max(edges.bbox[0].y, rect_min.y);
+	const int xend = std::min(edges.bbox[1].x, rect_max.x);
+	const int yend = std::min(edges.bbox[1].y, rect_max.y);
+	const vec2i clip_min = { .x = xbegin, .y = ybegin };
+	const vec2i clip_max = { .x = xend, .y = yend };
+
+	double offset[3][4];
+	double threshold[3];
+	// Edge values of the samples relative to the pixel center, and the largest of them
+	double sample_offset[3][MAX_SAMPLES];
+	double reach[3];
+	for (int i = 0; i < 3; i++) {
+		const double a = edges.A[i] * SUBPIXEL_STEPS;
+		const double b = edges.B[i] * SUBPIXEL_STEPS;
+		offset[i][0] = 0;
+		offset[i][1] = a;
+		offset[i][2] = b;
+		offset[i][3] = a + b;
+		threshold[i] = top_left_threshold(edges, i);
+		reach[i] = -INFINITY;
+		for (int s = 0; s < pattern.count; s++) {
+			sample_offset[i][s] = (edges.A[i] * pattern.x[s] + edges.B[i] * pattern.y[s]) * (SUBPIXEL_STEPS / 16);
+			reach[i] = std::max(reach[i], sample_offset[i][s]);
+		}
+	}
+	// Depth is linear on the screen, so a sample is its pixel center plus a constant
+	double sample_dz[MAX_SAMPLES];
+	for (int s = 0; s < pattern.count; s++) {
+		sample_dz[s] = (sample_offset[0][s] * vertex_z.x + sample_offset[1][s] * vertex_z.y
+						   + sample_offset[2][s] * vertex_z.z)
+			* edges.inv_area;
+	}
+
+	MultisampleQuad quad;
+	const int qxbegin = xbegin & ~1;
+	for (quad.y = ybegin & ~1; quad.y <= yend; quad.y += 2) {
+		double row[3];
+		for (int i = 0; i < 3; i++) {
+			row[i] = edges.A[i] * (qxbegin * SUBPIXEL_STEPS) + edges.B[i] * (quad.y * SUBPIXEL_STEPS) + edges.C[i];
+		}
+		for (quad.x = qxbegin; quad.x <= xend; quad.x += 2) {
+			// Edge values are exact integers, so they can be taken from the row start directly
+			const double dx = (quad.x - qxbegin) * SUBPIXEL_STEPS;
+			double w[3][4];
+			bool outside = false;
+			for (int i = 0; i < 3; i++) {
+				const double column = row[i] + edges.A[i] * dx;
+				for (int lane = 0; lane < 4; lane++)
+					w[i][lane] = column + offset[i][lane];
+				// No sample of the quad can be inside this edge
+				outside |= std::max({ w[i][0], w[i][1], w[i][2], w[i][3] }) + reach[i] < threshold[i];
+			}
+			if (outside)
+				continue;
+
+			quad.mask = 0;
+			const int in_rect = quad_rect_mask(quad.x, quad.y, clip_min, clip_max);
+			for (int lane = 0; lane < 4; lane++) {
+				quad.coverage[lane] = 0;
+				if (!(in_rect & (1 << lane)))
+					continue;
+				for (int s = 0; s < pattern.count; s++) {
+					if (w[0][lane] + sample_offset[0][s] >= threshold[0]
+						&& w[1][lane] + sample_offset[1][s] >= threshold[1]
+						&& w[2][lane] + sample_offset[2][s] >= threshold[2])
+						quad.coverage[lane] |= 1 << s;
+				}
+				if (quad.coverage[lane])
+					quad.mask |= 1 << lane;
+			}
+			if (!quad.mask)
+				continue;
+
+			for (int lane = 0; lane < 4; lane++) {
+				quad.z[lane]
+					= (w[0][lane] * vertex_z.x + w[1][lane] * vertex_z.y + w[2][lane] * vertex_z.z) * edges.inv_area;
+				for (int s = 0; s < pattern.count; s++)
+					quad.sample_z[lane][s] = quad.z[lane] + sample_dz[s];
+				const bool center
+					= w[0][lane] >= threshold[0] && w[1][lane] >= threshold[1] && w[2][lane] >= threshold[2];
+				const int s = std::countr_zero((unsigned int)quad.coverage[lane]);
+				for (int i = 0; i < 3; i++) {
+					const double centroid
+						= center || !quad.coverage[lane] ? w[i][lane] : w[i][lane] + sample_offset[i][s];
+					quad.barycentric[i][lane] = centroid * edges.inv_area;
+				}
+				if (edges.perspective) {
+					const double q0 = quad.barycentric[0][lane] * edges.rhw[0];
+					const double q1 = quad.barycentric[1][lane] * edges.rhw[1];
+					const double q2 = quad.barycentric[2][lane] * edges.rhw[2];
+					const double rw = 1.0 / (q0 + q1 + q2);
+					quad.barycentric[0][lane] = q0 * rw;
+					quad.barycentric[1][lane] = q1 * rw;
+					quad.barycentric[2][lane] = q2 * rw;
+				}
+			}
+			quad_fn(quad);
+		}
+	}
+}
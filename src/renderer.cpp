@@ -1,5 +1,7 @@
 #include "renderer.h"
 
+#include <numbers>
+
 // Applies the fn function to first three bytes (red, green, and blue)
 // be wary of the rollover
 std::uint32_t modify_channels(std::uint32_t color, std::uint8_t (*fn)(std::uint8_t)) {
@@ -45,6 +47,20 @@ mat<4,4> look_at(vec<3> eye, vec<3> center, vec<3> up) {
 	};
 }
 
+std::vector<CameraView> orbit_views(vec<3> eye, vec<3> center, vec<3> up, int count) {
+	const vec<3> axis = up.normalized();
+	const vec<3> offset = eye - center;
+	std::vector<CameraView> views;
+	for (int i = 0; i < count; i++) {
+		// Rodrigues' rotation of the offset around the axis
+		const double angle = 2 * std::numbers::pi * i / count;
+		const vec<3> rotated = offset*std::cos(angle) + cross(axis, offset)*std::sin(angle)
+			+ axis*((axis*offset)*(1 - std::cos(angle)));
+		views.push_back({ center + rotated, center, up });
+	}
+	return views;
+}
+
 // Returns the matrix which bounds (-1,+1)*(-1,+1)*(-1,+1) to (x, y)*(x+w, y+h)*(0,d)
 // -1 in the entry (1,1) needed to flip vertically
 mat<4,4> get_viewport(int x, int y, int w, int h, int d) {
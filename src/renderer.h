@@ -2,16 +2,26 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <concepts>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "clipper.h"
+#include "depth.h"
 #include "image.h"
+#include "image_writer.h"
 #include "mat_vec.h"
 #include "model.h"
+#include "multisample.h"
+#include "rasterizer.h"
 
 // Applies the fn function to first three bytes (red, green, and blue)
 // be wary of the rollover
@@ -25,6 +35,17 @@ float clampf(float low, float val, float high);
 mat<4, 4> scale(float scale);
 mat<4, 4> look_at(vec<3> eye, vec<3> center, vec<3> up);
 
+// Camera of a view, the arguments of look_at
+struct CameraView {
+	vec<3> eye;
+	vec<3> center;
+	vec<3> up;
+};
+
+// count views evenly spread on the circle that eye draws when turned around the up axis through center,
+// the first one is at eye
+std::vector<CameraView> orbit_views(vec<3> eye, vec<3> center, vec<3> up, int count);
+
 // Returns the matrix which bounds (-1,+1)*(-1,+1)*(-1,+1) to (x, y)*(x+w, y+h)*(0,d)
 // -1 in the entry (1,1) needed to flip vertically
 mat<4, 4> get_viewport(int x, int y, int w, int h, int d);
@@ -34,12 +55,91 @@ vec3 get_barycentric(std::array<vec4, 3> vertices, vec2i P);
 
 // Shaderclass which consists of an overwritable destructor
 // and pure virtual vertex/fragment functions representing corresponding shaders
-template <class pixel_T> struct ShaderClass {
+// vertex returns clip coordinates (Viewport*Projection*ModelView, no perspective divide),
+// the draw functions clip the triangles and divide by w themselves
+// T is the scalar type the shader works in
+template <class pixel_T, class T = double> struct ShaderClass {
 	virtual ~ShaderClass() {};
-	virtual vec4 vertex(int iface, int nthvert) = 0;
-	virtual bool fragment(vec3 barycentric, pixel_T& pixel) = 0;
+	// Called once per draw before any vertex/fragment, the default does nothing
+	virtual void setup_uniforms() {};
+	virtual vec<4, T> vertex(int iface, int nthvert) = 0;
+	virtual bool fragment(vec<3, T> barycentric, pixel_T& pixel) = 0;
+};
+
+// Scalar type of a shader, taken from what its vertex() returns
+template <class Shader>
+using shader_scalar_t = std::remove_cvref_t<decltype(std::declval<Shader&>().vertex(0, 0)[0])>;
+
+// Compile-time shader interface used by the draw functions
+// instantiated with a concrete (final) shader they call vertex/fragment directly
+// and the fragment body gets inlined into the raster loop,
+// instantiated with ShaderClass<pixel_T> they fall back to the virtual calls
+template <class Shader, class pixel_T>
+concept FragmentShader = requires(Shader& shader, int iface, int nthvert, vec<3, shader_scalar_t<Shader>> barycentric, pixel_T& pixel) {
+	{ shader.vertex(iface, nthvert) } -> std::convertible_to<vec<4, shader_scalar_t<Shader>>>;
+	{ shader.fragment(barycentric, pixel) } -> std::convertible_to<bool>;
+};
+
+// Runs the per-draw uniform setup of the shader if it has one
+// call it once before feeding the triangles of a draw to draw_shaded_triangle
+template <class Shader> void setup_shader_uniforms(Shader& shader)
+{
+	if constexpr (requires { shader.setup_uniforms(); }) {
+		shader.setup_uniforms();
+	}
+}
+
+// Shaders can opt into shading a whole 2x2 quad at once by providing
+// int fragment_quad(const FragmentQuad& quad, int mask, pixel_T (&pixels)[4])
+// mask has the lanes that passed the depth test, the returned mask has the discarded ones
+// every lane of the quad has its barycentrics, so derivatives can be taken across it
+template <class Shader, class pixel_T>
+concept QuadFragmentShader = FragmentShader<Shader, pixel_T>
+	&& requires(Shader& shader, const FragmentQuad& quad, int mask, pixel_T (&pixels)[4]) {
+		{ shader.fragment_quad(quad, mask, pixels) } -> std::convertible_to<int>;
+	};
+
+// Shaders can split their vertex stage for indexed drawing by providing
+// a Varyings struct with the per-vertex outputs,
+// vec<4,T> shade_vertex(int index, Varyings& out) const, which transforms the vertex
+// "index" of the welded vertex buffer (see BasicModel::vertices) without touching the shader,
+// and void assemble_vertex(int nthvert, const Varyings& in), which stores
+// the outputs as the nthvert-th varyings of the triangle
+template <class Shader>
+concept IndexedVertexShader = requires(const Shader& shader, Shader& triangle, int index, int nthvert,
+	typename Shader::Varyings& out) {
+	{ shader.shade_vertex(index, out) } -> std::convertible_to<vec<4, shader_scalar_t<Shader>>>;
+	triangle.assemble_vertex(nthvert, std::as_const(out));
 };
 
+// vertex() of an indexed shader, shades the vertex of a single face corner and assembles it right away
+// index is the vertex of the corner in the index buffer (VertexIndex::corner_vertex)
+template <class Shader> auto shade_face_corner(Shader& shader, int index, int nthvert)
+{
+	typename Shader::Varyings out;
+	auto position = shader.shade_vertex(index, out);
+	shader.assemble_vertex(nthvert, out);
+	return position;
+}
+
+// Screen space derivatives of the perspective-correct barycentrics of a triangle at a pixel,
+// for shaders that get single pixels and so cannot take differences across a quad
+// clip[i] has the x, y and w of the clip coordinates of the i-th vertex, barycentric are the ones at the pixel
+// With the clip coordinates as the rows of M, M^T barycentric = w (x, y, 1) at the pixel (x, y),
+// so barycentric = w M^-T (x, y, 1) and its derivatives follow with w = 1/sum(M^-T (x, y, 1))
+// the rows of M^-T are the cross products of the rows of M over its determinant
+template <class T>
+void barycentric_derivatives(const mat<3, 3, T>& clip, const vec<3, T>& barycentric, vec<3, T>& ddx, vec<3, T>& ddy)
+{
+	const vec<3, T> rows[3] = { cross(clip[1], clip[2]), cross(clip[2], clip[0]), cross(clip[0], clip[1]) };
+	const T w = barycentric * clip.col(2);
+	const T scale = w / (clip[0] * rows[0]);
+	const vec<3, T> dx = { rows[0].x, rows[1].x, rows[2].x };
+	const vec<3, T> dy = { rows[0].y, rows[1].y, rows[2].y };
+	ddx = (dx - barycentric * (dx.x + dx.y + dx.z)) * scale;
+	ddy = (dy - barycentric * (dy.x + dy.y + dy.z)) * scale;
+}
+
 // Reflects the vector "v" across the vector "line"
 template <unsigned int n> vec<n> reflect(vec<n> v, vec<n> line)
 {
@@ -90,51 +190,26 @@ void draw_triangle_textured_illuminated(std::array<vec4, 3> triangle_positions,
 	std::array<vec3, 3> triangle_textures, std::array<vec3, 3> triangle_normals,
 	Image<double>& zbuffer, Image<pixel_T>& canvas, Image<pixel_T>& texture, vec3 lighting_vector)
 {
-	// bbox[0] is the inner point
-	// bbox[1] is the outer point
-	vec2i bbox[2] = { { .x = (int)canvas.width, .y = (int)canvas.height },
-		{ .x = 0, .y = 0 } }; // These are just initial values, they will be changed below
-	for (int i = 0; i < 3; i++) {
-		bbox[0].x = triangle_positions[i][0] < bbox[0].x ? triangle_positions[i][0] : bbox[0].x;
-		bbox[0].y = triangle_positions[i][1] < bbox[0].y ? triangle_positions[i][1] : bbox[0].y;
-
-		bbox[1].x = triangle_positions[i][0] > bbox[1].x ? triangle_positions[i][0] : bbox[1].x;
-		bbox[1].y = triangle_positions[i][1] > bbox[1].y ? triangle_positions[i][1] : bbox[1].y;
-	}
-
-	// Barycentric coordinates
-	vec3 barycords;
-	// Point inside the bounding box
-	vec2i P = { .x = bbox[0].x, .y = bbox[0].y };
-	double zdepth = 0;
-	// Color
-	pixel_T color;
-	pixel_T illuminated_color;
-	vec3 normal;
-	double lighting_intensity;
-
-	// Looping over every single pixel in the box
-	for (; P.x <= bbox[1].x; P.x++) {
-		P.y = bbox[0].y;
-		for (; P.y <= bbox[1].y; P.y++) {
-			barycords = get_barycentric(triangle_positions, P);
-			if ((barycords.x < 0) || (barycords.y < 0) || (barycords.z < 0))
-				continue;
-
-			// Experimental
-			if (P.x < 0 || P.y < 0 || (int)canvas.width <= P.x || (int)canvas.height <= P.y)
+	TriangleEdges edges;
+	if (!setup_triangle_edges(triangle_positions, canvas.width, canvas.height, edges))
+		return;
+	const vec3 vertex_z = { triangle_positions[0][2], triangle_positions[1][2], triangle_positions[2][2] };
+	rasterize_quads(edges, vertex_z, edges.bbox[0], edges.bbox[1], [&](const FragmentQuad& quad) {
+		for (int lane = 0; lane < 4; lane++) {
+			if (!(quad.mask & (1 << lane)))
 				continue;
+			const int x = quad.x + (lane & 1);
+			const int y = quad.y + (lane >> 1);
+			const vec3 barycords = quad.get_barycentric(lane);
 
-			normal = barycords[0] * triangle_normals[0] + barycords[1] * triangle_normals[1]
+			vec3 normal = barycords[0] * triangle_normals[0] + barycords[1] * triangle_normals[1]
 				+ barycords[2] * triangle_normals[2];
-			lighting_intensity = normal * lighting_vector;
+			double lighting_intensity = normal * lighting_vector;
 
 			if (lighting_intensity <= 0)
 				continue;
 
-			zdepth = barycords.x * triangle_positions[0][2] + barycords.y * triangle_positions[1][2]
-				+ barycords.z * triangle_positions[2][2];
-			if (zdepth > zbuffer[P.y * canvas.width + P.x]) {
+			if (quad.z[lane] > zbuffer[y * canvas.width + x]) {
 
 				int texture_x = barycords[0] * triangle_textures[0][0]
 					+ barycords[1] * triangle_textures[1][0]
@@ -142,8 +217,8 @@ void draw_triangle_textured_illuminated(std::array<vec4, 3> triangle_positions,
 				int texture_y = barycords[0] * triangle_textures[0][1]
 					+ barycords[1] * triangle_textures[1][1]
 					+ barycords[2] * triangle_textures[2][1];
-				color = texture[texture_y * texture.width + texture_x];
-				illuminated_color = 0xff'00'00'00;
+				pixel_T color = texture[texture_y * texture.width + texture_x];
+				pixel_T illuminated_color = 0xff'00'00'00;
 
 				illuminated_color
 					+= ((pixel_T)(lighting_intensity * ((color & 0x000000ff) >> (8 * 0)))) * (1);
@@ -153,60 +228,237 @@ void draw_triangle_textured_illuminated(std::array<vec4, 3> triangle_positions,
 					+= ((pixel_T)(lighting_intensity * ((color & 0x00ff0000) >> (8 * 2))))
 					* (256 * 256);
 
-				canvas[P.y * canvas.width + P.x] = illuminated_color;
-				zbuffer[P.y * canvas.width + P.x] = zdepth;
+				canvas[y * canvas.width + x] = illuminated_color;
+				zbuffer[y * canvas.width + x] = quad.z[lane];
 			}
 		}
-	}
+	});
 }
 
-template <class pixel_T>
-void draw_shaded_triangle(std::array<vec4, 3> screen_coords, ShaderClass<pixel_T>& shader,
-	Image<pixel_T>& canvas, Image<double>& zbuffer)
+// Rasterizes the part of an already set up triangle that lies inside [rect_min, rect_max]
+// The barycentrics are handed to the shader in its own scalar type
+// and the depth is tested and stored in the DepthFormat of the zbuffer
+// to_face is set for the parts of clipped triangles, see assemble_triangle
+// returns the number of fragments that passed the depth test and were shaded
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T>
+int draw_shaded_triangle(const std::array<vec<4, shader_scalar_t<Shader>>, 3>& screen_coords, const TriangleEdges& edges,
+	vec2i rect_min, vec2i rect_max, Shader& shader, Image<pixel_T>& canvas, Image<depth_T>& zbuffer,
+	const mat<3, 3>* to_face = nullptr)
 {
-	// bbox[0] is the inner point
-	// bbox[1] is the outer point
-	vec2i bbox[2] = { { .x = (int)canvas.width, .y = (int)canvas.height },
-		{ .x = 0, .y = 0 } }; // These are initial values, they will be changed below
-	for (int i = 0; i < 3; i++) {
-		bbox[0].x = screen_coords[i][0] < bbox[0].x ? screen_coords[i][0] : bbox[0].x;
-		bbox[0].y = screen_coords[i][1] < bbox[0].y ? screen_coords[i][1] : bbox[0].y;
-
-		bbox[1].x = screen_coords[i][0] > bbox[1].x ? screen_coords[i][0] : bbox[1].x;
-		bbox[1].y = screen_coords[i][1] > bbox[1].y ? screen_coords[i][1] : bbox[1].y;
-	}
+	const vec3 vertex_z = { screen_coords[0][2], screen_coords[1][2], screen_coords[2][2] };
+	int shaded = 0;
+	rasterize_quads(edges, vertex_z, rect_min, rect_max, [&](const FragmentQuad& part_quad) {
+		FragmentQuad remapped;
+		const FragmentQuad& quad = to_face ? (remapped = face_quad(part_quad, *to_face)) : part_quad;
+		// Depth test for the whole quad first
+		int passed = 0;
+		depth_T depth[4];
+		for (int lane = 0; lane < 4; lane++) {
+			if (!(quad.mask & (1 << lane)))
+				continue;
+			const int idx = (quad.y + (lane >> 1)) * canvas.width + quad.x + (lane & 1);
+			depth[lane] = DepthFormat<depth_T>::encode(quad.z[lane]);
+			if (DepthFormat<depth_T>::passes(depth[lane], zbuffer[idx]))
+				passed |= 1 << lane;
+		}
+		if (!passed)
+			return;
+
+		pixel_T colors[4];
+		int discarded = 0;
+		if constexpr (QuadFragmentShader<Shader, pixel_T>) {
+			discarded = shader.fragment_quad(quad, passed, colors);
+		} else {
+			for (int lane = 0; lane < 4; lane++) {
+				if ((passed & (1 << lane)) && shader.fragment(vec_cast<shader_scalar_t<Shader>>(quad.get_barycentric(lane)), colors[lane]))
+					discarded |= 1 << lane;
+			}
+		}
+
+		const int written = passed & ~discarded;
+		for (int lane = 0; lane < 4; lane++) {
+			if (written & (1 << lane)) {
+				const int idx = (quad.y + (lane >> 1)) * canvas.width + quad.x + (lane & 1);
+				canvas[idx] = colors[lane];
+				zbuffer[idx] = depth[lane];
+			}
+		}
+		shaded += std::popcount((unsigned int)passed);
+	});
+	return shaded;
+}
+
+// Multisampled draw_shaded_triangle, canvas and zbuffer hold pattern.count samples of every pixel,
+// see MultisampleTarget, and the triangle has to be set up with SAMPLE_REACH
+// the depth test runs at every covered sample, the shader once per pixel at its center
+// and its color goes to the samples that passed
+// returns the number of pixels with a sample that passed the depth test and were shaded
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T>
+int draw_shaded_triangle(const std::array<vec<4, shader_scalar_t<Shader>>, 3>& screen_coords, const TriangleEdges& edges,
+	vec2i rect_min, vec2i rect_max, Shader& shader, Image<pixel_T>& canvas, Image<depth_T>& zbuffer,
+	const SamplePattern& pattern, const mat<3, 3>* to_face = nullptr)
+{
+	const vec3 vertex_z = { screen_coords[0][2], screen_coords[1][2], screen_coords[2][2] };
+	const int samples = pattern.count;
+	const int width = canvas.width / samples;
+	int shaded = 0;
+	rasterize_multisample_quads(edges, vertex_z, pattern, rect_min, rect_max, [&](const MultisampleQuad& quad) {
+		FragmentQuad remapped;
+		const FragmentQuad& face
+			= to_face ? (remapped = face_quad(quad, *to_face)) : static_cast<const FragmentQuad&>(quad);
+		// Depth test of every covered sample first
+		int passed = 0;
+		int passed_samples[4];
+		depth_T depth[4][MAX_SAMPLES];
+		for (int lane = 0; lane < 4; lane++) {
+			passed_samples[lane] = 0;
+			if (!(quad.mask & (1 << lane)))
+				continue;
+			const int idx = ((quad.y + (lane >> 1)) * width + quad.x + (lane & 1)) * samples;
+			for (int s = 0; s < samples; s++) {
+				if (!(quad.coverage[lane] & (1 << s)))
+					continue;
+				depth[lane][s] = DepthFormat<depth_T>::encode(quad.sample_z[lane][s]);
+				if (DepthFormat<depth_T>::passes(depth[lane][s], zbuffer[idx + s]))
+					passed_samples[lane] |= 1 << s;
+			}
+			if (passed_samples[lane])
+				passed |= 1 << lane;
+		}
+		if (!passed)
+			return;
 
-	// std::cout << "Bounding box:\n";
-	// std::cout << "x_0 = " << bbox[0].x << " y_0=" << bbox[0].y << '\n';
-	// std::cout << "x_1 = " << bbox[1].x << " y_1=" << bbox[1].y << '\n';
-
-	vec2i P = { .x = bbox[0].x, .y = bbox[0].y };
-	vec3 barycords;
-	double zdepth = 0.0;
-	pixel_T color;
-	bool discard;
-
-	// Looping over every single pixel in the box
-	for (; P.x <= bbox[1].x; P.x++) {
-		P.y = bbox[0].y;
-		for (; P.y <= bbox[1].y; P.y++) {
-			barycords = get_barycentric(screen_coords, P);
-			if ((barycords.x < 0) || (barycords.y < 0) || (barycords.z < 0))
-				continue; // Outside the triangle
-			if (P.x < 0 || P.y < 0 || (int)canvas.width <= P.x || (int)canvas.height <= P.y)
-				continue; // Outside the screen
-
-			zdepth = barycords.x * screen_coords[0][2] + barycords.y * screen_coords[1][2]
-				+ barycords.z * screen_coords[2][2];
-			if (zdepth > zbuffer[P.y * canvas.width + P.x]) {
-				discard = shader.fragment(barycords, color);
-				if (!discard) {
-					canvas[P.y * canvas.width + P.x] = color;
-					zbuffer[P.y * canvas.width + P.x] = zdepth;
+		pixel_T colors[4];
+		int discarded = 0;
+		if constexpr (QuadFragmentShader<Shader, pixel_T>) {
+			discarded = shader.fragment_quad(face, passed, colors);
+		} else {
+			for (int lane = 0; lane < 4; lane++) {
+				if ((passed & (1 << lane)) && shader.fragment(vec_cast<shader_scalar_t<Shader>>(face.get_barycentric(lane)), colors[lane]))
+					discarded |= 1 << lane;
+			}
+		}
+
+		const int written = passed & ~discarded;
+		for (int lane = 0; lane < 4; lane++) {
+			if (!(written & (1 << lane)))
+				continue;
+			const int idx = ((quad.y + (lane >> 1)) * width + quad.x + (lane & 1)) * samples;
+			for (int s = 0; s < samples; s++) {
+				if (passed_samples[lane] & (1 << s)) {
+					canvas[idx + s] = colors[lane];
+					zbuffer[idx + s] = depth[lane][s];
 				}
 			}
 		}
-	}
+		shaded += std::popcount((unsigned int)passed);
+	});
+	return shaded;
+}
+
+// Pixel of the visibility buffer of the deferred mode, face is -1 where nothing was drawn
+// barycentric are the ones of the whole face, in the scalar type of the shader
+template <class T> struct VisibilitySample {
+	int face = -1;
+	vec<3, T> barycentric;
+};
+
+// Depth-only counterpart of draw_shaded_triangle for the deferred mode
+// instead of shading the pixels that pass the depth test it records face and barycentrics
+// into the visibility buffer of the screen rectangle starting at "origin", "stride" samples per row
+// returns the number of pixels that passed the depth test
+template <class T, class depth_T>
+int draw_visibility_triangle(const std::array<vec<4, T>, 3>& screen_coords, const TriangleEdges& edges, vec2i rect_min,
+	vec2i rect_max, int face, VisibilitySample<T>* visibility, vec2i origin, int stride, Image<depth_T>& zbuffer,
+	const mat<3, 3>* to_face = nullptr)
+{
+	const vec3 vertex_z = { screen_coords[0][2], screen_coords[1][2], screen_coords[2][2] };
+	int passed = 0;
+	rasterize_quads(edges, vertex_z, rect_min, rect_max, [&](const FragmentQuad& part_quad) {
+		FragmentQuad remapped;
+		const FragmentQuad& quad = to_face ? (remapped = face_quad(part_quad, *to_face)) : part_quad;
+		for (int lane = 0; lane < 4; lane++) {
+			if (!(quad.mask & (1 << lane)))
+				continue;
+			const int x = quad.x + (lane & 1);
+			const int y = quad.y + (lane >> 1);
+			const depth_T depth = DepthFormat<depth_T>::encode(quad.z[lane]);
+			if (DepthFormat<depth_T>::passes(depth, zbuffer[y * zbuffer.width + x])) {
+				zbuffer[y * zbuffer.width + x] = depth;
+				visibility[(y - origin.y) * stride + x - origin.x] = { face, vec_cast<T>(quad.get_barycentric(lane)) };
+				passed++;
+			}
+		}
+	});
+	return passed;
+}
+
+// Multisampled draw_visibility_triangle, the visibility buffer and the zbuffer hold pattern.count samples
+// of every pixel, the samples that pass the depth test get the face and the barycentrics of the pixel center
+// returns the number of pixels with a sample that passed the depth test
+template <class T, class depth_T>
+int draw_visibility_triangle(const std::array<vec<4, T>, 3>& screen_coords, const TriangleEdges& edges, vec2i rect_min,
+	vec2i rect_max, int face, VisibilitySample<T>* visibility, vec2i origin, int stride, Image<depth_T>& zbuffer,
+	const SamplePattern& pattern, const mat<3, 3>* to_face = nullptr)
+{
+	const vec3 vertex_z = { screen_coords[0][2], screen_coords[1][2], screen_coords[2][2] };
+	const int samples = pattern.count;
+	const int width = zbuffer.width / samples;
+	int passed = 0;
+	rasterize_multisample_quads(edges, vertex_z, pattern, rect_min, rect_max, [&](const MultisampleQuad& quad) {
+		FragmentQuad remapped;
+		const FragmentQuad& face_barycentric
+			= to_face ? (remapped = face_quad(quad, *to_face)) : static_cast<const FragmentQuad&>(quad);
+		for (int lane = 0; lane < 4; lane++) {
+			if (!(quad.mask & (1 << lane)))
+				continue;
+			const int x = quad.x + (lane & 1);
+			const int y = quad.y + (lane >> 1);
+			const int idx = (y * width + x) * samples;
+			VisibilitySample<T>* pixel = visibility + ((y - origin.y) * stride + x - origin.x) * samples;
+			bool pixel_passed = false;
+			for (int s = 0; s < samples; s++) {
+				if (!(quad.coverage[lane] & (1 << s)))
+					continue;
+				const depth_T depth = DepthFormat<depth_T>::encode(quad.sample_z[lane][s]);
+				if (DepthFormat<depth_T>::passes(depth, zbuffer[idx + s])) {
+					zbuffer[idx + s] = depth;
+					pixel[s] = { face, vec_cast<T>(face_barycentric.get_barycentric(lane)) };
+					pixel_passed = true;
+				}
+			}
+			passed += pixel_passed;
+		}
+	});
+	return passed;
+}
+
+// Clips and rasterizes a triangle given in clip coordinates, as returned by the vertex shader
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T>
+void draw_shaded_triangle(const std::array<vec<4, shader_scalar_t<Shader>>, 3>& clip_coords, Shader& shader,
+	Image<pixel_T>& canvas, Image<depth_T>& zbuffer)
+{
+	assemble_triangle(clip_coords, canvas.width, canvas.height, CullMode::none, true, 0,
+		[&](const auto& screen_coords, const TriangleEdges& edges, const mat<3, 3>* to_face) {
+			draw_shaded_triangle(screen_coords, edges, edges.bbox[0], edges.bbox[1], shader, canvas, zbuffer, to_face);
+		});
+}
+
+// Same for a multisampled target
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T>
+void draw_shaded_triangle(const std::array<vec<4, shader_scalar_t<Shader>>, 3>& clip_coords, Shader& shader,
+	MultisampleTarget<pixel_T, depth_T>& target)
+{
+	const SamplePattern& pattern = *sample_pattern(target.samples);
+	assemble_triangle(clip_coords, target.width, target.height, CullMode::none, true, target.sample_reach(),
+		[&](const auto& screen_coords, const TriangleEdges& edges, const mat<3, 3>* to_face) {
+			draw_shaded_triangle(screen_coords, edges, edges.bbox[0], edges.bbox[1], shader, target.color, target.depth,
+				pattern, to_face);
+		});
 }
 
 template <class pixel_T>
@@ -258,22 +510,28 @@ template <class pixel_T> void img_fill(Image<pixel_T>& canvas, pixel_T color)
 	}
 }
 
+// Writes the canvas as a binary PPM in a single write, the low 3 bytes of every pixel are red, green and blue
 template <class pixel_T> int img_save(std::string filepath, Image<pixel_T>& canvas)
 {
-	std::uint8_t bytes[3] { 0, 0, 0 };
-	std::ofstream file;
-	file.open(filepath, std::ios::out | std::ios::binary);
-	if (file.is_open()) {
-		file << "P6\n" << canvas.width << " " << canvas.height << " " << "255" << "\n";
+	if constexpr (std::same_as<pixel_T, std::uint32_t>) {
+		return write_ppm(filepath, canvas);
+	} else {
+		std::ostringstream header;
+		header << "P6\n" << canvas.width << " " << canvas.height << " " << "255" << "\n";
+		std::string bytes = header.str();
+		bytes.reserve(bytes.size() + (std::size_t)canvas.width * canvas.height * 3);
 		for (unsigned int i = 0; i < canvas.width * canvas.height; i++) {
-			bytes[0] = (canvas[i] >> (8 * 0)) & 0xff;
-			bytes[1] = (canvas[i] >> (8 * 1)) & 0xff;
-			bytes[2] = (canvas[i] >> (8 * 2)) & 0xff;
-			file.write((char*)bytes, 3 * (sizeof(*bytes)));
+			bytes.push_back((canvas[i] >> (8 * 0)) & 0xff);
+			bytes.push_back((canvas[i] >> (8 * 1)) & 0xff);
+			bytes.push_back((canvas[i] >> (8 * 2)) & 0xff);
+		}
+		std::ofstream file;
+		file.open(filepath, std::ios::out | std::ios::binary);
+		file.write(bytes.data(), bytes.size());
+		if (!file.good()) {
+			std::cerr << "Error with file in img_save\n";
+			return -1;
 		}
 		return 0;
-	} else {
-		std::cerr << "Error with file in img_save\n";
-		return -1;
 	}
 }
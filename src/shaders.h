@@ -0,0 +1,381 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "./image.h"
+#include "./mat_vec.h"
+#include "./model.h"
+#include "./renderer.h"
+
+// Shaders are templates over their scalar type, double by default
+// they are final so that the draw functions instantiated
+// with them can resolve and inline vertex()/fragment() at compile time
+// The vertex work lives in shade_vertex(), which only depends on the welded vertex of the model,
+// so that draw_tiled_indexed can run it once per unique vertex
+
+// Light and camera the shaders bake their uniforms from
+template <class T> struct ShaderCamera {
+	vec<3,T> light_dir;
+	mat<4,4,T> Viewport;
+	mat<4,4,T> Projection;
+	mat<4,4,T> ModelView;
+};
+
+// Globals shared by the shaders, set them up before drawing
+// every scalar type has its own set, the double one is aliased below
+// setup_uniforms() bakes the light and the camera of the globals,
+// setup_uniforms(camera) the ones of a view given explicitly, as render_batch does
+template <class T> struct ShaderGlobals {
+	static inline BasicModel<T> mdl;
+	static inline vec<3,T> light_dir;
+	static inline mat<4,4,T> Viewport;
+	static inline mat<4,4,T> Projection;
+	static inline mat<4,4,T> ModelView;
+
+	static ShaderCamera<T> camera() { return { light_dir, Viewport, Projection, ModelView }; }
+};
+
+inline Model& mdl = ShaderGlobals<double>::mdl;
+inline vec3& light_dir = ShaderGlobals<double>::light_dir;
+inline mat<4,4>& Viewport = ShaderGlobals<double>::Viewport;
+inline mat<4,4>& Projection = ShaderGlobals<double>::Projection;
+inline mat<4,4>& ModelView = ShaderGlobals<double>::ModelView;
+
+// Camera uniforms and indexed vertex() shared by the shaders,
+// Derived is the final shader, it brings its Varyings, shade_vertex and assemble_vertex
+template <class Derived, class T>
+struct MeshShader : public ShaderClass<std::uint32_t, T> {
+	using G = ShaderGlobals<T>;
+
+	mat<4,4,T> uniform_M; // Projection*ModelView
+	mat<4,4,T> uniform_M_IT; // Projection*ModelView invert_transpose()
+	mat<4,4,T> uniform_MVP; // Viewport*Projection*ModelView
+	vec<3,T> uniform_light; // light_dir transformed by uniform_M, normalized
+
+	// Per-draw setup, bakes the values that are constant over the draw call
+	void setup_uniforms() override {
+		setup_uniforms(G::camera());
+	}
+
+	void setup_uniforms(const ShaderCamera<T>& camera) {
+		uniform_M     = camera.Projection*camera.ModelView;
+		uniform_M_IT  = uniform_M.invert_transpose();
+		uniform_MVP   = camera.Viewport*camera.Projection*camera.ModelView;
+		uniform_light = proj<3>(uniform_M*embed<4>(camera.light_dir)).normalized();
+	}
+
+	vec<4,T> vertex(int iface, int nthvert) override {
+		return shade_face_corner(static_cast<Derived&>(*this), G::mdl.vertex_index.corner_vertex[iface + nthvert], nthvert);
+	}
+};
+
+// Shaders lit from the interpolated vertex normals, position, normal and uv of every vertex are varyings
+template <class Derived, class T>
+struct SurfaceShader : public MeshShader<Derived, T> {
+	using G = ShaderGlobals<T>;
+
+	mat<3,3,T> varying_pos;
+	mat<3,3,T> varying_nrm;
+	mat<3,2,T> varying_uv;
+
+	struct Varyings {
+		vec<3,T> pos;
+		vec<3,T> nrm;
+		vec<2,T> uv;
+	};
+
+	vec<4,T> shade_vertex(int index, Varyings& out) const {
+		const MeshVertex<T>& mesh_vertex = G::mdl.vertices[index];
+		out.nrm = mesh_vertex.normal;
+		out.uv = proj<2>(mesh_vertex.tex_coord);
+
+		vec<4,T> gl_Vertex = embed<4>(mesh_vertex.position);
+		out.pos = proj<3>((this->uniform_M*gl_Vertex).w_normalized());
+
+		return this->uniform_MVP*gl_Vertex;
+	}
+
+	void assemble_vertex(int nthvert, const Varyings& in) {
+		varying_pos[nthvert] = in.pos;
+		varying_nrm[nthvert] = in.nrm;
+		varying_uv[nthvert] = in.uv;
+	}
+
+	// Diffuse term of the light for the interpolated normal
+	T diffuse(vec<3,T> barycentric) const {
+		vec<3,T> surface_normal = (varying_nrm.transpose() * barycentric).normalized();
+
+		vec<3,T> n = proj<3>(this->uniform_M_IT*embed<4>(surface_normal)).normalized(); // transformed normal
+		vec<3,T> l = this->uniform_light; // transformed light_dir
+
+		return std::max(T(0), n*l);
+	}
+};
+
+template <class T = double>
+struct DepthShader final : public MeshShader<DepthShader<T>, T> {
+	using G = ShaderGlobals<T>;
+	using MeshShader<DepthShader<T>, T>::uniform_M;
+	using MeshShader<DepthShader<T>, T>::uniform_MVP;
+
+	mat<3,3,T> varying_tri;
+
+	DepthShader() : varying_tri() {}
+
+	struct Varyings {
+		vec<3,T> tri;
+	};
+
+	vec<4,T> shade_vertex(int index, Varyings& out) const {
+		vec<4,T> gl_Vertex = embed<4>(G::mdl.vertices[index].position);
+		out.tri = proj<3>((uniform_M*gl_Vertex).w_normalized());
+
+		return uniform_MVP*gl_Vertex;
+	}
+
+	void assemble_vertex(int nthvert, const Varyings& in) {
+		varying_tri[nthvert] = in.tri;
+	}
+
+	// Gray level of the depth, the closer the brighter
+	bool fragment(vec<3,T> barycentric, std::uint32_t& color) override {
+		const T z = (varying_tri.transpose() * barycentric).z;
+		const std::uint32_t level = std::clamp((z + 1) * T(0.5) * 255, T(0), T(255));
+		color = 0xff000000 | level << 16 | level << 8 | level;
+		return false;
+	}
+};
+
+template <class T = double>
+struct FlatShader final : public SurfaceShader<FlatShader<T>, T> {
+	bool fragment(vec<3,T>, std::uint32_t& color) override {
+		color = 0xffa0a0a0;
+		return false;
+	}
+
+	// Every lane gets the same color, so the quad is filled at once
+	int fragment_quad(const FragmentQuad&, int, std::uint32_t (&colors)[4]) {
+		std::fill(colors, colors + 4, 0xffa0a0a0);
+		return 0;
+	}
+};
+
+template <class T = double>
+struct PosterizationShader final : public SurfaceShader<PosterizationShader<T>, T> {
+	// ambient is not used
+	int uniform_ambient;
+	// floats are the upper bounds for each posterization color
+	std::vector<std::pair<std::uint32_t, float>> uniform_colors_with_bounds{{0xffa0a0a0, 1.0}};
+
+	bool fragment(vec<3,T> barycentric, std::uint32_t& color) override {
+		float diffuse = this->diffuse(barycentric);
+
+		// I could write binary search here, but linear should do as well
+		// since number of posterization colors shouldn't be that high
+
+		for (const auto& color_with_upper_bound : uniform_colors_with_bounds) {
+			if (diffuse < color_with_upper_bound.second) {
+				color = color_with_upper_bound.first;
+				return false;
+			}
+		}
+		color = 0xffc0c0c0;
+		return false;
+	}
+};
+
+template <class T = double>
+struct PhongShader final : public SurfaceShader<PhongShader<T>, T> {
+	int uniform_ambient;
+
+	bool fragment(vec<3,T> barycentric, std::uint32_t& color) override {
+		constexpr std::uint8_t  default_channel = 0xe0;
+
+		float diffuse = this->diffuse(barycentric);
+
+		std::uint8_t* color_channel = (std::uint8_t*)&color;
+		for (int i = 0; i < 3; i++) {
+			color_channel[i] = uniform_ambient + default_channel*(1.0*diffuse);
+		}
+		color_channel[3] = 0xff; // Opaque, the resolve and the writers read the whole color
+		return false;
+	}
+};
+
+template <class T = double>
+struct CarcassShader final : public SurfaceShader<CarcassShader<T>, T> {
+	// ambient is not used
+	int uniform_ambient;
+
+	bool fragment(vec<3,T> barycentric, std::uint32_t& color) override {
+		constexpr double threshhold = 0.005;
+
+		if (barycentric.x <= threshhold || barycentric.y <= threshhold || barycentric.z <= threshhold) { 
+			color = 0xffc0c0c0;
+			return false;
+		} else {
+			return true;
+		}
+	}
+};
+
+template <class T = double>
+struct CutoffShader final : public SurfaceShader<CutoffShader<T>, T> {
+	using Surface = SurfaceShader<CutoffShader<T>, T>;
+	using G = ShaderGlobals<T>;
+
+	// ambient is not used
+	int uniform_ambient;
+
+	mat<3,3,T> varying_obj_coords;
+
+	struct Varyings : Surface::Varyings {
+		vec<3,T> obj_coords;
+	};
+
+	vec<4,T> shade_vertex(int index, Varyings& out) const {
+		out.obj_coords = G::mdl.vertices[index].position;
+		return Surface::shade_vertex(index, out);
+	}
+
+	void assemble_vertex(int nthvert, const Varyings& in) {
+		varying_obj_coords[nthvert] = in.obj_coords;
+		Surface::assemble_vertex(nthvert, in);
+	}
+
+	bool fragment(vec<3,T> barycentric, std::uint32_t& color) override {
+		constexpr std::uint8_t default_channel = 0xe0;
+
+		[[maybe_unused]] vec<3,T> pos = (varying_obj_coords.transpose() * barycentric);
+
+		//if (0 <= pos.y) {
+		//	return true;
+		//}
+
+		float diffuse = this->diffuse(barycentric);
+
+		std::uint8_t* color_channel = (std::uint8_t*)&color;
+		for (int i = 0; i < 3; i++) {
+			color_channel[i] = uniform_ambient + default_channel*diffuse;
+		}
+		color_channel[3] = 0xff; // Opaque, the resolve and the writers read the whole color
+		return false;
+	}
+};
+
+template <class T = double>
+struct TextureTangentNormalShader final : public MeshShader<TextureTangentNormalShader<T>, T> {
+	using G = ShaderGlobals<T>;
+	using MeshShader<TextureTangentNormalShader<T>, T>::uniform_M_IT;
+	using MeshShader<TextureTangentNormalShader<T>, T>::uniform_MVP;
+	using MeshShader<TextureTangentNormalShader<T>, T>::uniform_light;
+
+	int uniform_ambient;
+	TextureFilter uniform_filter = TextureFilter::trilinear;
+	mat<3,3,T> varying_nrm;
+	mat<3,3,T> varying_tan; // Tangents orthogonalized against the vertex normals
+	mat<3,3,T> varying_bitan;
+	mat<3,2,T> varying_uv;
+	/*
+	[u0, v0],
+	[u1, v1],
+	[u2, v2],
+	*/
+	mat<3,3,T> varying_clip; // x, y and w of the clip coordinates, for the uv derivatives of fragment()
+
+	struct Varyings {
+		vec<3,T> nrm;
+		vec<3,T> tan;
+		vec<3,T> bitan;
+		vec<2,T> uv;
+		vec<3,T> clip;
+	};
+
+	vec<4,T> shade_vertex(int index, Varyings& out) const {
+		const MeshVertex<T>& mesh_vertex = G::mdl.vertices[index];
+		out.nrm = mesh_vertex.normal;
+		out.uv = proj<2>(mesh_vertex.tex_coord);
+
+		// Tangent frame precomputed by the model, made orthonormal to this vertex normal
+		const vec<3,T>& n = out.nrm;
+		const vec<3,T>& tangent = mesh_vertex.tangent;
+		vec<3,T> t = tangent - n*(n*tangent);
+		if (t.norm2() < 1e-12) t = cross(n, std::abs(n.x) < 0.9 ? vec<3,T>{1, 0, 0} : vec<3,T>{0, 1, 0});
+		t = t.normalized();
+		vec<3,T> b = cross(n, t);
+		// Mirrored uv mapping flips the bitangent
+		if (b*mesh_vertex.bitangent < 0) b = b*T(-1);
+		out.tan = t;
+		out.bitan = b;
+
+		vec<4,T> gl_Vertex = embed<4>(mesh_vertex.position);
+		vec<4,T> clip = uniform_MVP*gl_Vertex;
+		out.clip = {clip.x, clip.y, clip.w};
+
+		return clip;
+	}
+
+	void assemble_vertex(int nthvert, const Varyings& in) {
+		varying_nrm[nthvert] = in.nrm;
+		varying_tan[nthvert] = in.tan;
+		varying_bitan[nthvert] = in.bitan;
+		varying_uv[nthvert] = in.uv;
+		varying_clip[nthvert] = in.clip;
+	}
+
+	// The deferred draws shade single pixels, the derivatives come from the triangle itself
+	bool fragment(vec<3,T> barycentric, std::uint32_t& color) override {
+		vec<3,T> ddx, ddy;
+		barycentric_derivatives(varying_clip, barycentric, ddx, ddy);
+		const TextureGradient gradient = {
+			vec_cast<float>(varying_uv.transpose() * ddx), vec_cast<float>(varying_uv.transpose() * ddy) };
+		shade(barycentric, (varying_uv.transpose()) * barycentric, gradient, color);
+		return false;
+	}
+
+	// The uv differences across the quad pick the mip levels, the same ones for its 4 pixels
+	int fragment_quad(const FragmentQuad& quad, int mask, std::uint32_t (&colors)[4]) {
+		vec<3,T> barycentric[4];
+		vec<2,T> uv[4];
+		for (int lane = 0; lane < 4; lane++) {
+			barycentric[lane] = vec_cast<T>(quad.get_barycentric(lane));
+			uv[lane] = (varying_uv.transpose()) * barycentric[lane];
+		}
+		const TextureGradient gradient = { vec_cast<float>(uv[1] - uv[0]), vec_cast<float>(uv[2] - uv[0]) };
+		for (int lane = 0; lane < 4; lane++) {
+			if (mask & (1 << lane))
+				shade(barycentric[lane], uv[lane], gradient, colors[lane]);
+		}
+		return 0;
+	}
+
+	void shade(vec<3,T> barycentric, vec<2,T> uv, const TextureGradient& gradient, std::uint32_t& color) const {
+		vec<3,T> surface_normal = (varying_nrm.transpose() * barycentric).normalized();
+
+		// Matrix for change of basis from tangent to object coords
+		mat<3,3,T> B;
+		B.set_col(0, varying_tan.transpose() * barycentric);
+		B.set_col(1, varying_bitan.transpose() * barycentric);
+		B.set_col(2, surface_normal);
+
+		// Transforming tangent-space normals to object coords
+		vec<3,T> normal = (B*G::mdl.get_normal(uv, gradient, uniform_filter)).normalized();
+
+		vec<3,T> n = proj<3>(uniform_M_IT*embed<4>(normal)).normalized(); // transformed normal
+		vec<3,T> l = uniform_light; // transformed light_dir
+		vec<3,T> r = (n*(2.f*n*l) - l).normalized(); // l reflected across the n
+		vec<4,float> texture_color = G::mdl.get_texture(uv, gradient, uniform_filter);
+
+		float diffuse = std::max(T(0), n*l);
+		// we take the z component because the camera is on the z-axis after the transformation
+		float specular = std::max(T(0), (T)std::pow(r.z, G::mdl.get_specular(uv, gradient, uniform_filter)));
+		std::uint8_t* color_channel = (std::uint8_t*)&color;
+		for (int i = 0; i < 3; i++){
+			color_channel[i] = uniform_ambient + texture_color[i]*(1.0*diffuse + 0.6*specular);
+		}
+		color_channel[3] = 0xff; // Opaque, the resolve and the writers read the whole color
+	}
+};
\ No newline at end of file
@@ -0,0 +1,78 @@
+// Faces with indices out of range have to be refused by load_obj with bad_face on their line,
+// both by the serial parse and by the chunked one, where the negative indices are resolved across the chunks
+// the .obj files are written into the temporary directory and removed at the end, returns 0 if every case passes
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "../model.h"
+#include "../parser.h"
+#include "../thread_pool.h"
+
+const std::string test_obj = (std::filesystem::temp_directory_path() / "obj_face_indices_test.obj").string();
+
+// Writes text into test_obj and loads it, serially or on the pool
+ObjResult load_text(const std::string& text, ThreadPool* pool)
+{
+	std::ofstream(test_obj, std::ios::binary) << text;
+	Model mdl;
+	return pool ? load_obj(test_obj, &mdl, *pool) : load_obj(test_obj, &mdl);
+}
+
+// Text large enough to be parsed in several chunks: vertices, then faces that reach back across the chunks
+std::string chunked_text(const std::string& last_face)
+{
+	std::string text;
+	const int nverts = 3 * OBJ_MIN_CHUNK_SIZE / 20;
+	for (int i = 0; i < nverts; i++)
+		text += "v 0.25 0.5 " + std::to_string(i) + "\n";
+	text += "vt 0 0\nvn 0 0 1\n";
+	text += "f 1 2 3\nf -1 -2 -" + std::to_string(nverts) + "\n";
+	return text + last_face;
+}
+
+int main()
+{
+	ThreadPool pool(4);
+	const std::string triangle = "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\n";
+	const std::size_t chunked_lines = 3 * OBJ_MIN_CHUNK_SIZE / 20 + 5;
+	struct Case {
+		const char* name;
+		std::string text;
+		bool chunked;
+		ObjError error;
+		std::size_t line;
+	} cases[] = {
+		{ "valid triangle", triangle + "f 1/1/1 2/1/1 -1/-1/-1\n", false, ObjError::none, 0 },
+		{ "position past the end", triangle + "f 1 2 99\n", false, ObjError::bad_face, 6 },
+		{ "position before the start", triangle + "f -1 -2 -7\n", false, ObjError::bad_face, 6 },
+		{ "uv before the start", triangle + "f 1/1 2/1 3/-2\n", false, ObjError::bad_face, 6 },
+		{ "normal past the end", triangle + "f 1 2 3\nf 1//1 2//1 3//2\n", false, ObjError::bad_face, 7 },
+		{ "polygon past the end", triangle + "f 1 2 3\nf 1 2 3 4\n", false, ObjError::bad_face, 7 },
+		{ "chunked valid", chunked_text(""), true, ObjError::none, 0 },
+		{ "chunked position past the end", chunked_text("f 1 2 999999999\n"), true, ObjError::bad_face, chunked_lines },
+		{ "chunked position before the start", chunked_text("f -1 -2 -999999999\n"), true, ObjError::bad_face, chunked_lines },
+		// -2 resolves to MISSING_INDEX once the single normal is counted in, it must not be taken for a missing one
+		{ "chunked normal before the start", chunked_text("f 1//1 2//1 3//-2\n"), true, ObjError::bad_face, chunked_lines },
+	};
+
+	int failed = 0;
+	for (const Case& test : cases) {
+		for (ThreadPool* on : { (ThreadPool*)nullptr, &pool }) {
+			if (!test.chunked && on)
+				continue;
+			const ObjResult result = load_text(test.text, on);
+			if (result.error != test.error || result.line != test.line) {
+				std::cerr << test.name << (on ? " (pool)" : " (serial)") << ": got \"" << obj_error_message(result.error)
+						  << "\" on line " << result.line << ", expected \"" << obj_error_message(test.error) << "\" on line "
+						  << test.line << '\n';
+				failed++;
+			}
+		}
+	}
+	std::error_code error;
+	std::filesystem::remove(test_obj, error);
+	std::cout << (failed ? "FAILED" : "passed") << '\n';
+	return failed ? -1 : 0;
+}
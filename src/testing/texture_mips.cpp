@@ -0,0 +1,52 @@
+// The mip levels of textures with odd sides have to keep their last row and column,
+// a 5x3 texture goes down to 2x1 then 1x1 and every level keeps the mean of the image
+// returns 0 if every check passes
+#include <cmath>
+#include <iostream>
+
+#include "../image.h"
+#include "../texture.h"
+
+// 5x3 texture with the given texels in row-major order
+Texture<float> texture_5x3(const float (&values)[15])
+{
+	Image<float> image(5, 3);
+	for (int i = 0; i < 15; i++)
+		image.data[i] = values[i];
+	return Texture<float>(image);
+}
+
+int failed = 0;
+
+void check(const char* name, float got, float expected)
+{
+	if (std::abs(got - expected) > 1e-5f) {
+		std::cerr << name << ": got " << got << ", expected " << expected << '\n';
+		failed++;
+	}
+}
+
+int main()
+{
+	const float ramp[15] = { 0, 1, 2, 3, 4, 10, 11, 12, 13, 14, 20, 21, 22, 23, 24 };
+	const Texture<float> texture = texture_5x3(ramp);
+	if (texture.levels() != 3 || texture.width(1) != 2 || texture.height(1) != 1 || texture.width(2) != 1
+		|| texture.height(2) != 1) {
+		std::cerr << "5x3 texture: wrong mip chain\n";
+		failed++;
+	} else {
+		// Columns (0, 1, 2) and (2, 3, 4) weighted 2/5, 2/5, 1/5 and 1/5, 2/5, 2/5, the 3 rows by 1/3
+		check("level 1, texel 0", texture.texel(1, 0, 0), (0.4f * 0 + 0.4f * 1 + 0.2f * 2) + 10);
+		check("level 1, texel 1", texture.texel(1, 1, 0), (0.2f * 2 + 0.4f * 3 + 0.4f * 4) + 10);
+		check("level 2", texture.texel(2, 0, 0), 12);
+	}
+
+	// A texel alone in the last column or row still counts for its share of the image
+	const float last_column[15] = { 0, 0, 0, 0, 5, 0, 0, 0, 0, 5, 0, 0, 0, 0, 5 };
+	check("last column", texture_5x3(last_column).texel(2, 0, 0), 1);
+	const float last_row[15] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 3, 3, 3, 3 };
+	check("last row", texture_5x3(last_row).texel(2, 0, 0), 1);
+
+	std::cout << (failed ? "FAILED" : "passed") << '\n';
+	return failed ? -1 : 0;
+}
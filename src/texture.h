@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+#include "mat_vec.h"
+
+// Side of the square tiles the texels of a Texture are stored in,
+// 4x4 texels of 32 bits are a single 64 byte cache line
+constexpr int TEXTURE_TILE_SIZE = 4;
+
+// nearest takes the closest texel of the closest mip level,
+// bilinear blends the 4 closest texels of the closest level,
+// trilinear blends the bilinear samples of the two levels around the level of detail
+enum class TextureFilter { nearest, bilinear, trilinear };
+
+// Screen space derivatives of the texture coordinates, they pick the mip level
+struct TextureGradient {
+	vec<2, float> dx;
+	vec<2, float> dy;
+};
+
+// Formats of the texels, Texture<texel_T> can be built if TexelFormat<texel_T> exists
+// filtered_T is what the filters blend and the samples return,
+// unpack(texel) turns a texel into it and pack(value) back, pack(unpack(texel)) is texel
+template <class texel_T> struct TexelFormat;
+
+// Image<std::uint32_t> colors, red in the low byte, filtered as one float per channel
+template <> struct TexelFormat<std::uint32_t> {
+	using filtered_T = vec<4, float>;
+	static filtered_T unpack(std::uint32_t texel) {
+		return { (float)(texel & 0xff), (float)((texel >> 8) & 0xff), (float)((texel >> 16) & 0xff), (float)(texel >> 24) };
+	}
+	static std::uint32_t pack(const filtered_T& value) {
+		std::uint32_t texel = 0;
+		for (int i = 0; i < 4; i++)
+			texel |= (std::uint32_t)std::clamp(value[i] + 0.5f, 0.f, 255.f) << (8 * i);
+		return texel;
+	}
+};
+
+// Pre-decoded values (normals, specular exponents) are filtered as they are
+template <> struct TexelFormat<float> {
+	using filtered_T = float;
+	static float unpack(float texel) { return texel; }
+	static float pack(float value) { return value; }
+};
+
+template <> struct TexelFormat<vec<3, float>> {
+	using filtered_T = vec<3, float>;
+	static vec<3, float> unpack(const vec<3, float>& texel) { return texel; }
+	static vec<3, float> pack(const vec<3, float>& value) { return value; }
+};
+
+// Tangent space normal of a normal map color, x = red, y = green, z = blue
+inline vec<3, float> decode_normal(std::uint32_t color)
+{
+	return { ((color & 0x000000ff) >> 0) / 255.f * 2.f - 1.f, ((color & 0x0000ff00) >> 8) / 255.f * 2.f - 1.f,
+		((color & 0x00ff0000) >> 16) / 255.f * 2.f - 1.f };
+}
+
+// Red channel of a color, grayscale images keep their value there
+inline float decode_red(std::uint32_t color)
+{
+	return color & 0xff;
+}
+
+// Image with its mip chain down to 1x1, every level halves the one above with a 2x2 box filter,
+// widened to 3 texels along the odd sides so that their last row or column is not dropped
+// the texels of a level are stored in TEXTURE_TILE_SIZE tiles, row by row of tiles,
+// so the texels around a sample share a cache line instead of being a row apart
+// Coordinates are clamped to the edges, uv.y is inverted (1-uv.y) like in the model accessors
+template <class texel_T> class Texture {
+public:
+	using filtered_T = typename TexelFormat<texel_T>::filtered_T;
+
+	// to_texel converts the pixels of the image into texels
+	template <class pixel_T, class Fn> Texture(const Image<pixel_T>& image, Fn&& to_texel)
+	{
+		add_level(image.width, image.height);
+		for (int y = 0; y < (int)image.height; y++) {
+			for (int x = 0; x < (int)image.width; x++)
+				texels[index(0, x, y)] = to_texel(image.data[y * image.width + x]);
+		}
+		while (width(levels() - 1) > 1 || height(levels() - 1) > 1) {
+			const int above = levels() - 1;
+			add_level(std::max(1, width(above) / 2), std::max(1, height(above) / 2));
+			for (int y = 0; y < height(above + 1); y++) {
+				const BoxTaps rows = box_taps(height(above), y);
+				for (int x = 0; x < width(above + 1); x++) {
+					const BoxTaps columns = box_taps(width(above), x);
+					filtered_T sum = texel(above, columns.first, rows.first) * (columns.weights[0] * rows.weights[0]);
+					for (int j = 0; j < rows.count; j++) {
+						for (int i = j ? 0 : 1; i < columns.count; i++)
+							sum = sum + texel(above, columns.first + i, rows.first + j) * (columns.weights[i] * rows.weights[j]);
+					}
+					texels[index(above + 1, x, y)] = TexelFormat<texel_T>::pack(sum);
+				}
+			}
+		}
+	}
+	explicit Texture(const Image<texel_T>& image) : Texture(image, [](const texel_T& pixel) { return pixel; }) {}
+
+	int levels() const { return chain.size(); }
+	int width(int level) const { return chain[level].width; }
+	int height(int level) const { return chain[level].height; }
+
+	// Texel of the level, x and y are clamped to it
+	filtered_T texel(int level, int x, int y) const {
+		x = std::clamp(x, 0, width(level) - 1);
+		y = std::clamp(y, 0, height(level) - 1);
+		return TexelFormat<texel_T>::unpack(texels[index(level, x, y)]);
+	}
+
+	// Level of detail of a sample, log2 of the texels the larger screen space step crosses
+	float level_of_detail(const TextureGradient& gradient) const {
+		const vec<2, float> size = { (float)width(0), (float)height(0) };
+		const float dx = vec<2, float> { gradient.dx.x * size.x, gradient.dx.y * size.y }.norm2();
+		const float dy = vec<2, float> { gradient.dy.x * size.x, gradient.dy.y * size.y }.norm2();
+		// Half of log2 of the squared length
+		return 0.5f * std::log2(std::max(dx, dy));
+	}
+
+	filtered_T sample_nearest(int level, vec<2, float> uv) const {
+		return texel(level, (int)std::floor(uv.x * width(level)), (int)std::floor((1 - uv.y) * height(level)));
+	}
+
+	filtered_T sample_bilinear(int level, vec<2, float> uv) const {
+		// Texel centers are at half coordinates
+		const float x = uv.x * width(level) - 0.5f;
+		const float y = (1 - uv.y) * height(level) - 0.5f;
+		const int x0 = std::floor(x);
+		const int y0 = std::floor(y);
+		const float tx = x - x0;
+		const float ty = y - y0;
+		// Clamped once for the 4 texels
+		const int left = std::clamp(x0, 0, width(level) - 1);
+		const int right = std::clamp(x0 + 1, 0, width(level) - 1);
+		const int top = std::clamp(y0, 0, height(level) - 1);
+		const int bottom = std::clamp(y0 + 1, 0, height(level) - 1);
+		const auto unpack = [&](int x, int y) { return TexelFormat<texel_T>::unpack(texels[index(level, x, y)]); };
+		return (unpack(left, top) * (1 - tx) + unpack(right, top) * tx) * (1 - ty)
+			+ (unpack(left, bottom) * (1 - tx) + unpack(right, bottom) * tx) * ty;
+	}
+
+	// Filtered sample at uv, gradient picks the levels, magnified samples come from the full resolution level
+	filtered_T sample(vec<2, float> uv, const TextureGradient& gradient, TextureFilter filter) const {
+		float lod = level_of_detail(gradient);
+		lod = lod > 0 ? std::min(lod, (float)(levels() - 1)) : 0;
+		if (filter == TextureFilter::nearest)
+			return sample_nearest(std::lround(lod), uv);
+		if (filter == TextureFilter::bilinear)
+			return sample_bilinear(std::lround(lod), uv);
+		const int level = lod;
+		const float t = lod - level;
+		if (t == 0)
+			return sample_bilinear(level, uv);
+		return sample_bilinear(level, uv) * (1 - t) + sample_bilinear(level + 1, uv) * t;
+	}
+
+private:
+	struct Level {
+		int width;
+		int height;
+		unsigned int tiles_x;
+		std::size_t offset; // Of the first texel in texels
+	};
+
+	// Texels of the level above that the texel i of the level below averages along one side
+	struct BoxTaps {
+		int first;
+		int count;
+		float weights[3];
+	};
+
+	// An even side of n texels halves into n/2 with 2 taps of 1/2, an odd one of 2n+1 into n with 3 taps
+	// weighted (n-i, n, i+1)/(2n+1), which still gives every texel above the same total weight
+	static BoxTaps box_taps(int size_above, int i) {
+		if (size_above == 1)
+			return { 0, 1, { 1.f, 0.f, 0.f } };
+		if (size_above % 2 == 0)
+			return { 2 * i, 2, { 0.5f, 0.5f, 0.f } };
+		const float n = size_above / 2;
+		return { 2 * i, 3, { (n - i) / size_above, n / size_above, (i + 1) / (float)size_above } };
+	}
+
+	void add_level(int level_width, int level_height) {
+		const unsigned int tiles_x = (level_width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+		const int tiles_y = (level_height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+		chain.push_back({ level_width, level_height, tiles_x, texels.size() });
+		texels.resize(texels.size() + (std::size_t)tiles_x * tiles_y * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE);
+	}
+
+	// x and y have to be inside the level, unsigned so that the tile math is shifts and masks
+	std::size_t index(int level, unsigned int x, unsigned int y) const {
+		const Level& l = chain[level];
+		const std::size_t tile = (y / TEXTURE_TILE_SIZE) * l.tiles_x + x / TEXTURE_TILE_SIZE;
+		return l.offset + tile * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE + (y % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE
+			+ x % TEXTURE_TILE_SIZE;
+	}
+
+	std::vector<Level> chain;
+	std::vector<texel_T> texels;
+};
@@ -1,7 +1,16 @@
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <iostream>
 #include <cstring>
 #include "tgaimage.h"
+#include "thread_pool.h"
+
+// The swizzle kernels are built with per-function target attributes and picked at runtime
+#if defined(__GNUC__) && defined(__SSE2__)
+#define TGA_SIMD
+#include <immintrin.h>
+#endif
 
 TGAImage::TGAImage(const int w, const int h, const int bpp) : w(w), h(h), bpp(bpp), data(w*h*bpp, 0) {}
 
@@ -9,23 +18,26 @@ std::uint8_t* TGAImage::get_data(){
 	return this->data.data();
 }
 
+const std::uint8_t* TGAImage::get_data() const{
+	return this->data.data();
+}
+
 int TGAImage::get_bpp() const{
 	return this->bpp;
 }
 
 bool TGAImage::read_tga_file(const std::string filename) {
-	std::ifstream file;
-	file.open(filename, std::ios::binary);
+	MappedFile file(filename);
 	if (!file.is_open()) {
 		std::cerr << "can't open file " << filename << "\n";
 		return false;
 	}
 	TGAHeader header;
-	file.read(reinterpret_cast<char *>(&header), sizeof(header));
-	if (!file.good()) {
+	if (file.size() < sizeof(header)) {
 		std::cerr << "an error occured while reading the header\n";
 		return false;
 	}
+	std::memcpy(&header, file.data(), sizeof(header));
 	w   = header.width;
 	h   = header.height;
 	bpp = header.bitsperpixel>>3;
@@ -33,16 +45,22 @@ bool TGAImage::read_tga_file(const std::string filename) {
 		std::cerr << "bad bpp (or width/height) value\n";
 		return false;
 	}
+	// The pixels follow the image id and the color map
+	std::size_t offset = sizeof(header) + header.idlength;
+	if (header.colormaptype)
+		offset += header.colormaplength * ((header.colormapdepth + 7) >> 3);
+	const std::uint8_t* pixels = (const std::uint8_t*)file.data() + std::min(offset, file.size());
+	const std::size_t available = file.size() - std::min(offset, file.size());
 	size_t nbytes = bpp*w*h;
 	data = std::vector<std::uint8_t>(nbytes, 0);
 	if (3==header.datatypecode || 2==header.datatypecode) {
-		file.read(reinterpret_cast<char *>(data.data()), nbytes);
-		if (!file.good()) {
+		if (available < nbytes) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
+		std::memcpy(data.data(), pixels, nbytes);
 	} else if (10==header.datatypecode||11==header.datatypecode) {
-		if (!load_rle_data(file)) {
+		if (!tga_rle_decode(pixels, available, bpp, data.data(), (std::size_t)w*h)) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
@@ -54,60 +72,144 @@ bool TGAImage::read_tga_file(const std::string filename) {
 		flip_vertically();
 	if (header.imagedescriptor & 0x10)
 		flip_horizontally();
-	std::cerr << w << "x" << h << "/" << bpp*8 << "\n";
 	return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-	size_t pixelcount = w*h;
-	size_t currentpixel = 0;
-	size_t currentbyte  = 0;
-	TGAColor colorbuffer;
-	do {
-		std::uint8_t chunkheader = 0;
-		chunkheader = in.get();
-		if (!in.good()) {
-			std::cerr << "an error occured while reading the data\n";
-			return false;
+// Copies the pixel at dst over the next count - 1 pixels, doubling the copied part every time
+static void fill_run(std::uint8_t* dst, int bpp, std::size_t count) {
+	if (bpp == 1) {
+		std::memset(dst + 1, dst[0], count - 1);
+		return;
+	}
+	const std::size_t total = count*bpp;
+	for (std::size_t filled = bpp; filled < total; filled *= 2)
+		std::memcpy(dst + filled, dst, std::min(filled, total - filled));
+}
+
+std::size_t tga_rle_decode(const std::uint8_t* src, std::size_t size, int bpp, std::uint8_t* dst, std::size_t npixels) {
+	TGARleDecoder decoder(src, size, bpp);
+	if (!decoder.decode(dst, npixels) || decoder.pending())
+		return 0;
+	return decoder.position() - src;
+}
+
+bool TGARleDecoder::decode(std::uint8_t* dst, std::size_t npixels) {
+	if (!npixels) return true;
+	std::uint8_t* const dst_end = dst + npixels*bpp;
+	if (pending_count) {
+		const std::size_t count = std::min(pending_count, npixels);
+		std::memcpy(dst, pos, pending_run ? bpp : count*bpp);
+		if (pending_run)
+			fill_run(dst, bpp, count);
+		else
+			pos += count*bpp;
+		pending_count -= count;
+		if (pending_run && !pending_count)
+			pos += bpp;
+		dst += count*bpp;
+	}
+	while (dst < dst_end) {
+		// One bounds check per packet, for its header and its pixels
+		if (pos == end) return false;
+		const std::uint8_t chunkheader = *pos++;
+		const bool run = chunkheader & 0x80;
+		const std::size_t count = (chunkheader & 0x7f) + 1;
+		const std::size_t packet = run ? bpp : count*bpp;
+		if ((std::size_t)(end - pos) < packet) return false;
+		// The part of the packet that fits, the rest waits for the next piece
+		const std::size_t fits = std::min(count, (std::size_t)(dst_end - dst)/bpp);
+		std::memcpy(dst, pos, run ? bpp : fits*bpp);
+		if (run)
+			fill_run(dst, bpp, fits);
+		dst += fits*bpp;
+		if (fits < count) {
+			pending_count = count - fits;
+			pending_run = run;
+			if (!run) pos += fits*bpp;
+			return true;
 		}
-		if (chunkheader<128) {
-			chunkheader++;
-			for (int i=0; i<chunkheader; i++) {
-				in.read(reinterpret_cast<char *>(colorbuffer.bgra), bpp);
-				if (!in.good()) {
-					std::cerr << "an error occured while reading the header\n";
-					return false;
-				}
-				for (int t=0; t<bpp; t++)
-					data[currentbyte++] = colorbuffer.bgra[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
+		pos += packet;
+	}
+	return true;
+}
+
+// Encodes with the pixels read as bpp byte integers, which a fixed bpp turns into single loads
+template <int bpp>
+static void rle_encode(const std::uint8_t* src, std::size_t npixels, std::vector<std::uint8_t>& out) {
+	constexpr std::size_t max_chunk_length = 128;
+	// 24 bit pixels but the last are read as 32 bits with the byte of the next pixel masked out
+	const auto pixel = [src, npixels](std::size_t i) {
+		std::uint32_t value = 0;
+		if (bpp == 3 && i + 1 < npixels) {
+			std::memcpy(&value, src + i*bpp, 4);
+			return std::endian::native == std::endian::little ? value & 0x00ffffff : value & 0xffffff00;
+		}
+		std::memcpy(&value, src + i*bpp, bpp);
+		return value;
+	};
+	// A packet header costs a byte over the pixels, a run of two saves bpp - 1 of them,
+	// so at worst one byte per 128 pixels, or per 3 pixels (a raw one and a run of two) in grayscale
+	const std::size_t overhead = bpp == 1 ? npixels/3 + 1 : (npixels + max_chunk_length - 1)/max_chunk_length;
+	const std::size_t start = out.size();
+	out.resize(start + npixels*bpp + overhead);
+	std::uint8_t* dst = out.data() + start;
+	std::size_t i = 0;
+	while (i < npixels) {
+		const std::uint32_t first = pixel(i);
+		std::size_t length = 1;
+		while (i + length < npixels && length < max_chunk_length && pixel(i + length) == first)
+			length++;
+		if (length > 1) {
+			*dst++ = length + 127;
+			std::memcpy(dst, src + i*bpp, bpp);
+			dst += bpp;
 		} else {
-			chunkheader -= 127;
-			in.read(reinterpret_cast<char *>(colorbuffer.bgra), bpp);
-			if (!in.good()) {
-				std::cerr << "an error occured while reading the header\n";
-				return false;
-			}
-			for (int i=0; i<chunkheader; i++) {
-				for (int t=0; t<bpp; t++)
-					data[currentbyte++] = colorbuffer.bgra[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
+			// Raw pixels up to where two equal ones start a run, a full packet takes the last one anyway
+			// next is the pixel after the packet, so every pixel is read once
+			std::uint32_t next = i + 1 < npixels ? pixel(i + 1) : 0;
+			while (i + length < npixels && length < max_chunk_length) {
+				const std::uint32_t current = next;
+				if (length + 1 < max_chunk_length && i + length + 1 < npixels) {
+					next = pixel(i + length + 1);
+					if (next == current)
+						break;
 				}
+				length++;
 			}
+			*dst++ = length - 1;
+			std::memcpy(dst, src + i*bpp, length*bpp);
+			dst += length*bpp;
 		}
-	} while (currentpixel < pixelcount);
-	return true;
+		i += length;
+	}
+	out.resize(dst - out.data());
+}
+
+void tga_rle_encode(const std::uint8_t* src, int bpp, std::size_t npixels, std::vector<std::uint8_t>& out) {
+	switch (bpp) {
+	case TGAImage::GRAYSCALE: rle_encode<1>(src, npixels, out); break;
+	case TGAImage::RGB: rle_encode<3>(src, npixels, out); break;
+	case TGAImage::RGBA: rle_encode<4>(src, npixels, out); break;
+	}
 }
 
 bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const {
+	return ::write_tga_file(filename, pixel_source(), vflip, rle);
+}
+
+bool TGAImage::write_tga_file(const std::string filename, ThreadPool& pool, const bool vflip, const bool rle) const {
+	return ::write_tga_file(filename, pixel_source(), vflip, rle, &pool);
+}
+
+TGAPixelSource TGAImage::pixel_source() const {
+	// The rows are handed out of data as they are
+	return { w, h, bpp, [this](int y, int, std::uint8_t*) { return data.data() + (std::size_t)y*w*bpp; } };
+}
+
+bool write_tga_file(const std::string& filename, const TGAPixelSource& source, const bool vflip, const bool rle, ThreadPool* pool) {
+	const int w = source.width;
+	const int h = source.height;
+	const int bpp = source.bpp;
 	constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
 	constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
 	constexpr std::uint8_t footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
@@ -121,22 +223,46 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
 	header.bitsperpixel = bpp<<3;
 	header.width  = w;
 	header.height = h;
-	header.datatypecode = (bpp==GRAYSCALE?(rle?11:3):(rle?10:2));
+	header.datatypecode = (bpp==TGAImage::GRAYSCALE?(rle?11:3):(rle?10:2));
 	header.imagedescriptor = vflip ? 0x00 : 0x20; // top-left or bottom-left origin
 	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
 	if (!out.good()) {
 		std::cerr << "can't dump the tga file\n";
 		return false;
 	}
+	const int nranges = (h + TGA_RLE_RANGE_ROWS - 1) / TGA_RLE_RANGE_ROWS;
+	const std::size_t range_bytes = (std::size_t)TGA_RLE_RANGE_ROWS*w*bpp;
 	if (!rle) {
-		out.write(reinterpret_cast<const char *>(data.data()), w*h*bpp);
+		std::vector<std::uint8_t> scratch(range_bytes);
+		for (int range = 0; range < nranges; range++) {
+			const int rows = std::min(TGA_RLE_RANGE_ROWS, h - range*TGA_RLE_RANGE_ROWS);
+			out.write(reinterpret_cast<const char *>(source.rows(range*TGA_RLE_RANGE_ROWS, rows, scratch.data())), (std::size_t)rows*w*bpp);
+		}
 		if (!out.good()) {
 			std::cerr << "can't unload raw data\n";
 			return false;
 		}
-	} else if (!unload_rle_data(out)) {
-		std::cerr << "can't unload rle data\n";
-		return false;
+	} else {
+		// Ranges of rows are encoded on their own and written in order
+		std::vector<std::vector<std::uint8_t>> packets(nranges);
+		std::vector<std::vector<std::uint8_t>> scratch(pool ? pool->size() : 1, std::vector<std::uint8_t>(range_bytes));
+		const auto encode = [&](int range, unsigned int worker) {
+			const int rows = std::min(TGA_RLE_RANGE_ROWS, h - range*TGA_RLE_RANGE_ROWS);
+			const std::uint8_t* pixels = source.rows(range*TGA_RLE_RANGE_ROWS, rows, scratch[worker].data());
+			tga_rle_encode(pixels, bpp, (std::size_t)rows*w, packets[range]);
+		};
+		if (pool) {
+			pool->parallel_for(nranges, encode);
+		} else {
+			for (int range = 0; range < nranges; range++)
+				encode(range, 0);
+		}
+		for (const std::vector<std::uint8_t>& range_packets : packets)
+			out.write(reinterpret_cast<const char *>(range_packets.data()), range_packets.size());
+		if (!out.good()) {
+			std::cerr << "can't unload rle data\n";
+			return false;
+		}
 	}
 	out.write(reinterpret_cast<const char *>(developer_area_ref), sizeof(developer_area_ref));
 	if (!out.good()) {
@@ -156,46 +282,6 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
 	return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) const {
-	const std::uint8_t max_chunk_length = 128;
-	size_t npixels = w*h;
-	size_t curpix = 0;
-	while (curpix<npixels) {
-		size_t chunkstart = curpix*bpp;
-		size_t curbyte = curpix*bpp;
-		std::uint8_t run_length = 1;
-		bool raw = true;
-		while (curpix+run_length<npixels && run_length<max_chunk_length) {
-			bool succ_eq = true;
-			for (int t=0; succ_eq && t<bpp; t++)
-				succ_eq = (data[curbyte+t]==data[curbyte+t+bpp]);
-			curbyte += bpp;
-			if (1==run_length)
-				raw = !succ_eq;
-			if (raw && succ_eq) {
-				run_length--;
-				break;
-			}
-			if (!raw && !succ_eq)
-				break;
-			run_length++;
-		}
-		curpix += run_length;
-		out.put(raw?run_length-1:run_length+127);
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
-		}
-		out.write(reinterpret_cast<const char *>(data.data()+chunkstart), (raw?run_length*bpp:bpp));
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
-		}
-	}
-	return true;
-}
-
 TGAColor TGAImage::get(const int x, const int y) const {
 	if (!data.size() || x<0 || y<0 || x>=w || y>=h)
 		return {};
@@ -234,3 +320,128 @@ int TGAImage::height() const {
 	return h;
 }
 
+
+#ifdef TGA_SIMD
+// 4 pixels per shuffle, every 16 byte load uses its first 12 bytes
+// returns how many pixels were converted, the loads stop before reading past the source
+[[gnu::target("ssse3")]] static std::size_t bgr_to_rgba_ssse3(const std::uint8_t* src, std::uint32_t* dst, std::size_t count) {
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	std::size_t i = 0;
+	for (; i + 6 <= count; i += 4) {
+		const __m128i bgr = _mm_loadu_si128((const __m128i*)(src + 3*i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_shuffle_epi8(bgr, shuffle), alpha));
+	}
+	return i;
+}
+
+[[gnu::target("ssse3")]] static std::size_t bgra_to_rgba_ssse3(const std::uint8_t* src, std::uint32_t* dst, std::size_t count) {
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128i bgra = _mm_loadu_si128((const __m128i*)(src + 4*i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(bgra, shuffle));
+	}
+	return i;
+}
+
+static bool cpu_has_ssse3() {
+	static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+	return has_ssse3;
+}
+#endif
+
+void tga_to_rgba(const std::uint8_t* src, int bpp, std::uint32_t* dst, std::size_t count) {
+	std::size_t i = 0;
+	switch (bpp) {
+	case TGAImage::GRAYSCALE:
+		for (; i < count; i++)
+			dst[i] = src[i];
+		break;
+	case TGAImage::RGB:
+#ifdef TGA_SIMD
+		if (cpu_has_ssse3()) i = bgr_to_rgba_ssse3(src, dst, count);
+#endif
+		for (; i < count; i++)
+			dst[i] = 0xff000000u | src[3*i] << 16 | src[3*i+1] << 8 | src[3*i+2];
+		break;
+	case TGAImage::RGBA:
+#ifdef TGA_SIMD
+		if (cpu_has_ssse3()) i = bgra_to_rgba_ssse3(src, dst, count);
+#endif
+		for (; i < count; i++)
+			dst[i] = (std::uint32_t)src[4*i+3] << 24 | src[4*i] << 16 | src[4*i+1] << 8 | src[4*i+2];
+		break;
+	}
+}
+
+TGAFile::TGAFile(const std::string& filename) : file(filename) {
+	if (!file.is_open()) {
+		std::cerr << "can't open file " << filename << "\n";
+		return;
+	}
+	if (file.size() < sizeof(header)) {
+		std::cerr << "an error occured while reading the header\n";
+		return;
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	const int bpp = get_bpp();
+	if (header.width == 0 || header.height == 0 || (bpp != TGAImage::GRAYSCALE && bpp != TGAImage::RGB && bpp != TGAImage::RGBA)) {
+		std::cerr << "bad bpp (or width/height) value\n";
+		return;
+	}
+	if (header.datatypecode != 2 && header.datatypecode != 3 && header.datatypecode != 10 && header.datatypecode != 11) {
+		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
+		return;
+	}
+	offset = sizeof(header) + header.idlength;
+	if (header.colormaptype)
+		offset += header.colormaplength * ((header.colormapdepth + 7) >> 3);
+	valid = offset <= file.size();
+	if (!valid)
+		std::cerr << "an error occured while reading the header\n";
+}
+
+bool TGAFile::decode(std::uint32_t* pixels) const {
+	if (!valid) return false;
+	const int w = header.width;
+	const int h = header.height;
+	const int bpp = get_bpp();
+	const bool top_down = header.imagedescriptor & 0x20;
+	const std::uint8_t* pos = (const std::uint8_t*)file.data() + offset;
+	const std::uint8_t* const end = (const std::uint8_t*)file.data() + file.size();
+	// Row y of the file, bottom-up files start at the last row of the image
+	const auto row = [&](int y) { return pixels + (std::size_t)(top_down ? y : h-1-y)*w; };
+
+	if (header.datatypecode == 2 || header.datatypecode == 3) {
+		if ((std::size_t)(end - pos) < (std::size_t)w*h*bpp) {
+			std::cerr << "an error occured while reading the data\n";
+			return false;
+		}
+		for (int y = 0; y < h; y++)
+			tga_to_rgba(pos + (std::size_t)y*w*bpp, bpp, row(y), w);
+	} else {
+		// Expanded a band of rows at a time into a buffer that stays in cache, then converted into the image
+		const int band_rows = std::max(1, TGA_DECODE_BAND_BYTES/(w*bpp));
+		std::vector<std::uint8_t> band((std::size_t)band_rows*w*bpp);
+		TGARleDecoder decoder(pos, end - pos, bpp);
+		for (int y = 0; y < h; y += band_rows) {
+			const int rows = std::min(band_rows, h - y);
+			if (!decoder.decode(band.data(), (std::size_t)rows*w)) {
+				std::cerr << "an error occured while reading the data\n";
+				return false;
+			}
+			for (int i = 0; i < rows; i++)
+				tga_to_rgba(band.data() + (std::size_t)i*w*bpp, bpp, row(y + i), w);
+		}
+		if (decoder.pending()) {
+			std::cerr << "Too many pixels read\n";
+			return false;
+		}
+	}
+	if (header.imagedescriptor & 0x10) {
+		for (int y = 0; y < h; y++)
+			std::reverse(row(y), row(y) + w);
+	}
+	return true;
+}
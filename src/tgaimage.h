@@ -2,8 +2,21 @@
 #include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <string>
 #include <vector>
 
+#include "mapped_file.h"
+
+class ThreadPool;
+struct TGAPixelSource;
+
+// RLE packets of written files never span more than this many rows,
+// so that ranges of rows can be encoded independently and the output does not depend on the threads
+constexpr int TGA_RLE_RANGE_ROWS = 32;
+// Bytes of RLE data TGAFile expands at a time before converting them into the image
+constexpr int TGA_DECODE_BAND_BYTES = 64*1024;
+
 #pragma pack(push,1)
 struct TGAHeader {
 	std::uint8_t  idlength = 0;
@@ -34,6 +47,8 @@ struct TGAImage {
 	TGAImage(const int w, const int h, const int bpp);
 	bool  read_tga_file(const std::string filename);
 	bool write_tga_file(const std::string filename, const bool vflip=true, const bool rle=true) const;
+	// Encodes ranges of TGA_RLE_RANGE_ROWS rows on the threads of the pool, the file is the same
+	bool write_tga_file(const std::string filename, ThreadPool& pool, const bool vflip=true, const bool rle=true) const;
 	void flip_horizontally();
 	void flip_vertically();
 	TGAColor get(const int x, const int y) const;
@@ -42,12 +57,85 @@ struct TGAImage {
 	int height() const;
 	int get_bpp() const;
 	std::uint8_t* get_data();
+	const std::uint8_t* get_data() const;
 	private:
-	bool   load_rle_data(std::ifstream &in);
-	bool unload_rle_data(std::ofstream &out) const;
+	TGAPixelSource pixel_source() const;
 
 	int w = 0;
 	int h = 0;
 	std::uint8_t bpp = 0;
 	std::vector<std::uint8_t> data = {};
 };
+
+// Pixels of a TGA file being written, gray, bgr or bgra as TGA stores them, bpp bytes each
+// rows(y, count, scratch) returns the rows [y, y + count), either straight out of the image
+// or converted into scratch, which has room for count rows; the threads of a pool call it at the same time
+struct TGAPixelSource {
+	int width;
+	int height;
+	int bpp;
+	std::function<const std::uint8_t*(int y, int count, std::uint8_t* scratch)> rows;
+};
+
+// The writer behind TGAImage::write_tga_file, with the ranges of TGA_RLE_RANGE_ROWS rows encoded on the pool if there is one
+// vflip marks the rows as bottom to top
+bool write_tga_file(const std::string& filename, const TGAPixelSource& source, const bool vflip, const bool rle, ThreadPool* pool = nullptr);
+
+// Expands the RLE packets in [src, src + size) into npixels pixels of bpp bytes at dst,
+// runs are filled with wide copies of their pixel and raw packets are copied at once
+// returns the bytes of src that were used, 0 if the data ends early or holds more than npixels pixels
+std::size_t tga_rle_decode(const std::uint8_t* src, std::size_t size, int bpp, std::uint8_t* dst, std::size_t npixels);
+
+// tga_rle_decode in pieces, so that an image can be expanded a few rows at a time into a small buffer
+// a packet that goes on over the end of a piece is finished by the next call
+class TGARleDecoder {
+public:
+	TGARleDecoder(const std::uint8_t* src, std::size_t size, int bpp) : pos(src), end(src + size), bpp(bpp) {}
+
+	// Expands the next npixels pixels into dst, returns false if the data ends early
+	bool decode(std::uint8_t* dst, std::size_t npixels);
+	// Pixels left of a packet split by the last piece
+	std::size_t pending() const { return pending_count; }
+	// Next byte of the data to be read
+	const std::uint8_t* position() const { return pos; }
+
+private:
+	const std::uint8_t* pos;
+	const std::uint8_t* end;
+	int bpp;
+	std::size_t pending_count = 0;
+	bool pending_run = false; // pos is then at the pixel of the run
+};
+
+// Appends the RLE packets of npixels pixels of bpp bytes to out
+// a packet is a run of up to 128 equal pixels or up to 128 raw pixels that end before the next two equal ones
+void tga_rle_encode(const std::uint8_t* src, int bpp, std::size_t npixels, std::vector<std::uint8_t>& out);
+
+// Converts count pixels of bpp bytes (gray, bgr or bgra as TGA stores them) into the layout of
+// Image<std::uint32_t>: red in the low byte, then green, blue and alpha (0xff for bgr),
+// gray only fills the low byte
+// bgr and bgra are shuffled 4 pixels at a time with SSSE3 if the CPU has it
+void tga_to_rgba(const std::uint8_t* src, int bpp, std::uint32_t* dst, std::size_t count);
+
+// TGA file mapped into memory, which decodes into the pixels of an Image<std::uint32_t>,
+// raw data straight from the file and RLE data through a TGARleDecoder, a band of rows at a time
+// the rows are written top to bottom whatever the origin of the file, so nothing is flipped afterwards
+// An unreadable or unsupported file is reported on std::cerr and has a size of 0x0
+class TGAFile {
+public:
+	explicit TGAFile(const std::string& filename);
+
+	bool is_valid() const { return valid; }
+	int width() const { return valid ? header.width : 0; }
+	int height() const { return valid ? header.height : 0; }
+	int get_bpp() const { return header.bitsperpixel >> 3; }
+
+	// pixels has width()*height() entries, returns false on truncated or corrupt data
+	bool decode(std::uint32_t* pixels) const;
+
+private:
+	MappedFile file;
+	TGAHeader header = {};
+	std::size_t offset = 0; // Of the pixel data, past the header, the image id and the color map
+	bool valid = false;
+};
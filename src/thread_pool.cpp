@@ -0,0 +1,67 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int nthreads)
+{
+	if (nthreads == 0) {
+		nthreads = std::max(1U, std::thread::hardware_concurrency());
+	}
+	for (unsigned int worker = 1; worker < nthreads; worker++) {
+		workers.emplace_back(&ThreadPool::worker_loop, this, worker);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(const std::function<void(unsigned int)>& job)
+{
+	if (workers.empty()) {
+		job(0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		current_job = &job;
+		pending = workers.size();
+		generation++;
+	}
+	wake.notify_all();
+	job(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return pending == 0; });
+	current_job = nullptr;
+}
+
+void ThreadPool::worker_loop(unsigned int worker)
+{
+	unsigned long long seen_generation = 0;
+	while (true) {
+		const std::function<void(unsigned int)>* job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen_generation; });
+			if (stopping)
+				return;
+			seen_generation = generation;
+			job = current_job;
+		}
+		(*job)(worker);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0)
+				done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads which are kept alive between jobs
+// the thread calling run()/parallel_for() takes part in the job as the worker 0
+class ThreadPool {
+public:
+	// nthreads = 0 uses every core of the machine
+	explicit ThreadPool(unsigned int nthreads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Amount of workers including the calling thread
+	unsigned int size() const { return workers.size() + 1; }
+
+	// Calls job(worker) once on every worker and blocks until all of them return
+	// jobs must not call run() of the same pool
+	void run(const std::function<void(unsigned int)>& job);
+
+	// Calls fn(i, worker) for every i in [0, count), indices are handed out dynamically
+	// worker is in [0, size()) and can be used to index per-thread scratch data
+	template <class Fn> void parallel_for(int count, Fn&& fn)
+	{
+		std::atomic<int> next { 0 };
+		run([&](unsigned int worker) {
+			for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+				fn(i, worker);
+			}
+		});
+	}
+
+private:
+	void worker_loop(unsigned int worker);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(unsigned int)>* current_job = nullptr;
+	unsigned long long generation = 0;
+	unsigned int pending = 0;
+	bool stopping = false;
+};
@@ -0,0 +1,494 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "clipper.h"
+#include "hiz.h"
+#include "image.h"
+#include "mat_vec.h"
+#include "multisample.h"
+#include "rasterizer.h"
+#include "renderer.h"
+#include "thread_pool.h"
+
+// Side of the square screen tiles in pixels
+constexpr int TILE_SIZE = 64;
+// Every hierarchical depth block belongs to a single tile, and so to a single worker
+static_assert(TILE_SIZE % HIZ_BLOCK_SIZE == 0);
+
+// Faces assembled by a job of the vertex stage
+constexpr int ASSEMBLY_JOB_FACES = 256;
+
+// Triangle that went through the vertex shader and the primitive assembly
+// its varyings are not kept here, they are loaded into the shader of the worker drawing it
+// a clipped triangle is drawn as its parts, edges.bbox is then the union of theirs
+template <class T> struct BinnedTriangle {
+	std::array<vec<4, T>, 3> screen_coords;
+	TriangleEdges edges;
+	TriangleSetup setup;
+	// Parts in BinnedTriangles::parts, none when the triangle is drawn whole
+	int first_part = 0;
+	int nparts = 0;
+};
+
+// Triangles of a draw in the face order
+// the parts of the clipped ones are listed per assembly job, so that the jobs append them without locks
+template <class T> struct BinnedTriangles {
+	explicit BinnedTriangles(int nfaces)
+		: faces(nfaces, BinnedTriangle<T> { {}, {}, TriangleSetup::offscreen })
+		, parts((nfaces + ASSEMBLY_JOB_FACES - 1) / ASSEMBLY_JOB_FACES)
+	{
+	}
+
+	const ClippedTriangle<T>* parts_of(int face) const
+	{
+		return parts[face / ASSEMBLY_JOB_FACES].data() + faces[face].first_part;
+	}
+
+	std::vector<BinnedTriangle<T>> faces;
+	std::vector<std::vector<ClippedTriangle<T>>> parts;
+};
+
+// Clips and sets up the triangle from the clip coordinates of its vertices, its parts go to the end of parts
+template <class T>
+void assemble_binned_triangle(BinnedTriangle<T>& tri, std::vector<ClippedTriangle<T>>& parts,
+	const std::array<vec<4, T>, 3>& clip_coords, int width, int height, CullMode cull, bool perspective,
+	double sample_reach)
+{
+	tri.first_part = parts.size();
+	tri.setup = assemble_triangle(clip_coords, width, height, cull, perspective, sample_reach,
+		[&](const auto& screen_coords, const TriangleEdges& edges, const mat<3, 3>* to_face) {
+			if (!to_face) {
+				tri.screen_coords = screen_coords;
+				tri.edges = edges;
+				return;
+			}
+			if (!tri.nparts) {
+				tri.edges.bbox[0] = edges.bbox[0];
+				tri.edges.bbox[1] = edges.bbox[1];
+			}
+			tri.edges.bbox[0] = { std::min(tri.edges.bbox[0].x, edges.bbox[0].x), std::min(tri.edges.bbox[0].y, edges.bbox[0].y) };
+			tri.edges.bbox[1] = { std::max(tri.edges.bbox[1].x, edges.bbox[1].x), std::max(tri.edges.bbox[1].y, edges.bbox[1].y) };
+			parts.push_back({ screen_coords, edges, *to_face });
+			tri.nparts++;
+		});
+}
+
+// Per-draw settings of the tiled renderer
+// deferred splits the raster stage of every tile in two: the triangles only fill
+// a visibility buffer with the face and barycentrics of the closest one,
+// then every visible pixel of the tile is shaded once
+// the discarded fragments of a deferred draw keep the old color instead of showing
+// what is behind them, so shaders that discard (CarcassShader) should draw forward
+// perspective off interpolates the varyings linearly in screen space,
+// which skips a division per quad but warps textures on faces that recede from the camera
+// rows_done(y_begin, y_end) is called once the pixel rows [y_begin, y_end) of a row of tiles are final,
+// by the worker that finished its last tile while the other tiles are still being drawn,
+// so the rows can be resolved or written out early; the rows of tiles come in any order
+// setup_uniforms off draws with the uniforms the shader already has, when the caller set them up itself
+struct DrawOptions {
+	CullMode cull = CullMode::none;
+	bool deferred = false;
+	bool perspective = true;
+	std::function<void(int y_begin, int y_end)> rows_done {};
+	bool setup_uniforms = true;
+};
+
+// Counters of a draw call
+struct DrawStats {
+	int faces = 0;
+	int shaded_vertices = 0; // Vertex shader invocations
+	// Faces rejected by the primitive assembly
+	int culled = 0;
+	int degenerate = 0;
+	int offscreen = 0;
+	// Triangle/block pairs tested against the hierarchical depth and the ones found hidden
+	long long hiz_tested = 0;
+	long long hiz_rejected = 0;
+	long long depth_passes = 0;
+	long long fragments_shaded = 0; // Fragment shader invocations
+	long long visible_pixels = 0; // Pixels covered by the draw, only counted by the deferred mode
+	// Triangles loaded into the shader of a worker, once per tile they are drawn in
+	// and once per change of face while shading a deferred tile
+	long long triangle_loads = 0;
+
+	// Face corners served per vertex shader invocation, 1 without indexing
+	double vertex_reuse() const { return shaded_vertices ? 3.0 * faces / shaded_vertices : 0; }
+	// Depth test passes per covered pixel
+	double overdraw() const { return visible_pixels ? (double)depth_passes / visible_pixels : 0; }
+};
+
+// Stages 2 and 3 of draw_tiled, shared with draw_tiled_indexed
+// 2. binning, each worker sorts a contiguous range of faces into the screen tiles
+// 3. rasterization, each tile is owned by one worker so the canvas needs no locks,
+//    the triangles are walked per 8x8 block and skipped in the blocks where
+//    the hierarchical depth shows them hidden, in the deferred mode
+//    the worker then shades the visibility buffer of the tile while it is still in cache
+// Every worker draws with its own copy of the prepared shader (uniforms set up),
+// load_triangle(shader, face) puts the varyings of the face into that copy before the face is drawn
+// canvas and zbuffer hold pattern.count samples of every pixel, see MultisampleTarget
+// rows_done is DrawOptions::rows_done, called after the last tile of every row of tiles
+// returns the counters from the primitive assembly on
+template <class pixel_T, class Shader, class depth_T, class LoadTriangle>
+DrawStats draw_binned_triangles(const BinnedTriangles<shader_scalar_t<Shader>>& triangles, const Shader& prepared,
+	const LoadTriangle& load_triangle, Image<pixel_T>& canvas, Image<depth_T>& zbuffer, const SamplePattern& pattern,
+	ThreadPool& pool, bool deferred, const std::function<void(int, int)>& rows_done = {})
+{
+	using T = shader_scalar_t<Shader>;
+	const int nfaces = triangles.faces.size();
+	const int samples = pattern.count;
+	const int width = canvas.width / samples;
+	const int height = canvas.height;
+	const int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	const int ntiles = tiles_x * tiles_y;
+
+	// bins[range][tile] are the faces of the range touching the tile, in order
+	const int nranges = pool.size();
+	std::vector<std::vector<std::vector<int>>> bins(nranges, std::vector<std::vector<int>>(ntiles));
+	std::vector<DrawStats> range_stats(nranges);
+	pool.parallel_for(nranges, [&](int range, unsigned int) {
+		const int begin = (long long)nfaces * range / nranges;
+		const int end = (long long)nfaces * (range + 1) / nranges;
+		for (int face = begin; face < end; face++) {
+			const BinnedTriangle<T>& tri = triangles.faces[face];
+			if (tri.setup != TriangleSetup::visible) {
+				range_stats[range].culled += tri.setup == TriangleSetup::culled;
+				range_stats[range].degenerate += tri.setup == TriangleSetup::degenerate;
+				range_stats[range].offscreen += tri.setup == TriangleSetup::offscreen;
+				continue;
+			}
+			for (int ty = tri.edges.bbox[0].y / TILE_SIZE; ty <= tri.edges.bbox[1].y / TILE_SIZE; ty++) {
+				for (int tx = tri.edges.bbox[0].x / TILE_SIZE; tx <= tri.edges.bbox[1].x / TILE_SIZE; tx++) {
+					bins[range][ty * tiles_x + tx].push_back(face);
+				}
+			}
+		}
+	});
+
+	HierarchicalZ<depth_T> hiz(zbuffer, samples);
+	std::vector<DrawStats> worker_stats(pool.size());
+	std::vector<Shader> worker_shaders(pool.size(), prepared);
+	// Face whose varyings are in the shader of each worker
+	std::vector<int> worker_faces(pool.size(), -1);
+	// Visibility buffer of the tile each worker is on, only used by the deferred mode
+	std::vector<std::vector<VisibilitySample<T>>> tile_visibility(
+		pool.size(), std::vector<VisibilitySample<T>>(deferred ? TILE_SIZE * TILE_SIZE * samples : 0));
+	const auto draw_tile = [&](int tile, unsigned int worker) {
+		const vec2i tile_min = { .x = (tile % tiles_x) * TILE_SIZE, .y = (tile / tiles_x) * TILE_SIZE };
+		const vec2i tile_max = { .x = std::min(tile_min.x + TILE_SIZE, width) - 1,
+			.y = std::min(tile_min.y + TILE_SIZE, height) - 1 };
+		VisibilitySample<T>* visibility = tile_visibility[worker].data();
+		Shader& shader = worker_shaders[worker];
+		auto load = [&](int face) {
+			if (worker_faces[worker] == face)
+				return;
+			load_triangle(shader, face);
+			worker_faces[worker] = face;
+			worker_stats[worker].triangle_loads++;
+		};
+		// Depth passes in [rect_min, rect_max], shading them unless deferred
+		auto draw_rect = [&](int face, const auto& screen_coords, const TriangleEdges& edges, vec2i rect_min,
+							 vec2i rect_max, const mat<3, 3>* to_face) {
+			int passes;
+			if (deferred) {
+				passes = samples == 1
+					? draw_visibility_triangle(
+						  screen_coords, edges, rect_min, rect_max, face, visibility, tile_min, TILE_SIZE, zbuffer, to_face)
+					: draw_visibility_triangle(screen_coords, edges, rect_min, rect_max, face, visibility, tile_min,
+						  TILE_SIZE, zbuffer, pattern, to_face);
+			} else {
+				load(face);
+				passes = samples == 1
+					? draw_shaded_triangle(screen_coords, edges, rect_min, rect_max, shader, canvas, zbuffer, to_face)
+					: draw_shaded_triangle(
+						  screen_coords, edges, rect_min, rect_max, shader, canvas, zbuffer, pattern, to_face);
+				worker_stats[worker].fragments_shaded += passes;
+			}
+			worker_stats[worker].depth_passes += passes;
+			return passes;
+		};
+		auto draw_blocks = [&](int face, const auto& screen_coords, const TriangleEdges& edges, const mat<3, 3>* to_face) {
+			// Interpolated depths can exceed the vertex ones by a rounding error
+			const double z[3] = { (double)screen_coords[0][2], (double)screen_coords[1][2], (double)screen_coords[2][2] };
+			const depth_T nearest = DepthFormat<depth_T>::encode(std::max({ z[0], z[1], z[2] })
+				+ (std::abs(z[0]) + std::abs(z[1]) + std::abs(z[2])) * 1e-12);
+			const vec2i lo = { std::max(edges.bbox[0].x, tile_min.x), std::max(edges.bbox[0].y, tile_min.y) };
+			const vec2i hi = { std::min(edges.bbox[1].x, tile_max.x), std::min(edges.bbox[1].y, tile_max.y) };
+			const vec2i blocks_lo = { lo.x / HIZ_BLOCK_SIZE, lo.y / HIZ_BLOCK_SIZE };
+			const vec2i blocks_hi = { hi.x / HIZ_BLOCK_SIZE, hi.y / HIZ_BLOCK_SIZE };
+			// hidden has bit i set for the i-th block in row-major order, a tile has at most 64 blocks
+			std::uint64_t hidden = 0;
+			int nblocks = 0;
+			for (int by = blocks_lo.y; by <= blocks_hi.y; by++) {
+				for (int bx = blocks_lo.x; bx <= blocks_hi.x; bx++, nblocks++) {
+					if (!DepthFormat<depth_T>::passes(nearest, hiz.farthest(bx, by)))
+						hidden |= std::uint64_t(1) << nblocks;
+				}
+			}
+			worker_stats[worker].hiz_tested += nblocks;
+			worker_stats[worker].hiz_rejected += std::popcount(hidden);
+
+			// Walking the whole rectangle at once is cheaper when no block can be skipped
+			if (!hidden) {
+				if (draw_rect(face, screen_coords, edges, lo, hi, to_face)) {
+					for (int by = blocks_lo.y; by <= blocks_hi.y; by++)
+						for (int bx = blocks_lo.x; bx <= blocks_hi.x; bx++)
+							hiz.invalidate(bx, by);
+				}
+				return;
+			}
+			int block = 0;
+			for (int by = blocks_lo.y; by <= blocks_hi.y; by++) {
+				for (int bx = blocks_lo.x; bx <= blocks_hi.x; bx++, block++) {
+					if (hidden & (std::uint64_t(1) << block))
+						continue;
+					const vec2i block_min = { std::max(lo.x, bx * HIZ_BLOCK_SIZE), std::max(lo.y, by * HIZ_BLOCK_SIZE) };
+					const vec2i block_max = { std::min(hi.x, (bx + 1) * HIZ_BLOCK_SIZE - 1),
+						std::min(hi.y, (by + 1) * HIZ_BLOCK_SIZE - 1) };
+					if (draw_rect(face, screen_coords, edges, block_min, block_max, to_face))
+						hiz.invalidate(bx, by);
+				}
+			}
+		};
+		for (int range = 0; range < nranges; range++) {
+			for (int face : bins[range][tile]) {
+				const BinnedTriangle<T>& tri = triangles.faces[face];
+				if (!tri.nparts) {
+					draw_blocks(face, tri.screen_coords, tri.edges, nullptr);
+					continue;
+				}
+				const ClippedTriangle<T>* parts = triangles.parts_of(face);
+				for (int part = 0; part < tri.nparts; part++) {
+					draw_blocks(face, parts[part].screen_coords, parts[part].edges, &parts[part].to_face);
+				}
+			}
+		}
+		if (!deferred)
+			return;
+
+		for (int y = tile_min.y; y <= tile_max.y; y++) {
+			for (int x = tile_min.x; x <= tile_max.x; x++) {
+				VisibilitySample<T>* pixel = visibility + ((y - tile_min.y) * TILE_SIZE + x - tile_min.x) * samples;
+				pixel_T* color = &canvas[(y * width + x) * samples];
+				bool visible = false;
+				// Every face visible in the pixel is shaded once, its color goes to all of its samples
+				for (int s = 0; s < samples; s++) {
+					const int face = pixel[s].face;
+					if (face == -1)
+						continue;
+					pixel_T shaded;
+					load(face);
+					const bool discarded = shader.fragment(pixel[s].barycentric, shaded);
+					for (int other = s; other < samples; other++) {
+						if (pixel[other].face != face)
+							continue;
+						if (!discarded)
+							color[other] = shaded;
+						pixel[other].face = -1; // Cleared for the next tile of the worker
+					}
+					worker_stats[worker].fragments_shaded++;
+					visible = true;
+				}
+				worker_stats[worker].visible_pixels += visible;
+			}
+		}
+	};
+	// Tiles finished in every row of tiles
+	std::vector<std::atomic<int>> row_tiles_done(tiles_y);
+	pool.parallel_for(ntiles, [&](int tile, unsigned int worker) {
+		draw_tile(tile, worker);
+		if (!rows_done)
+			return;
+		const int tile_row = tile / tiles_x;
+		// acq_rel, the last worker sees the pixels of the other tiles of the row
+		if (row_tiles_done[tile_row].fetch_add(1, std::memory_order_acq_rel) + 1 == tiles_x)
+			rows_done(tile_row * TILE_SIZE, std::min((tile_row + 1) * TILE_SIZE, height));
+	});
+
+	DrawStats stats;
+	for (const DrawStats& counts : range_stats) {
+		stats.culled += counts.culled;
+		stats.degenerate += counts.degenerate;
+		stats.offscreen += counts.offscreen;
+	}
+	for (const DrawStats& counts : worker_stats) {
+		stats.hiz_tested += counts.hiz_tested;
+		stats.hiz_rejected += counts.hiz_rejected;
+		stats.depth_passes += counts.depth_passes;
+		stats.fragments_shaded += counts.fragments_shaded;
+		stats.visible_pixels += counts.visible_pixels;
+		stats.triangle_loads += counts.triangle_loads;
+	}
+	return stats;
+}
+
+// Stage 1 of draw_tiled: the vertex shader and the primitive assembly
+// of faces [0, nfaces) in parallel, the bounding boxes are widened by sample_reach
+// prepared has its uniforms set up, every job runs vertex() on its own copy
+template <class Shader>
+BinnedTriangles<shader_scalar_t<Shader>> assemble_faces(int nfaces, const Shader& prepared, int width, int height,
+	double sample_reach, ThreadPool& pool, const DrawOptions& options)
+{
+	BinnedTriangles<shader_scalar_t<Shader>> triangles(nfaces);
+	pool.parallel_for(triangles.parts.size(), [&](int job, unsigned int) {
+		Shader shader = prepared;
+		const int end = std::min(nfaces, (job + 1) * ASSEMBLY_JOB_FACES);
+		for (int face = job * ASSEMBLY_JOB_FACES; face < end; face++) {
+			std::array<vec<4, shader_scalar_t<Shader>>, 3> clip_coords;
+			for (int nthvert = 0; nthvert < 3; nthvert++) {
+				clip_coords[nthvert] = shader.vertex(3 * face, nthvert);
+			}
+			assemble_binned_triangle(triangles.faces[face], triangles.parts[job], clip_coords, width, height,
+				options.cull, options.perspective, sample_reach);
+		}
+	});
+	return triangles;
+}
+
+// Stage 1 of draw_tiled_indexed, the vertex stage runs once per unique vertex of the index
+// into a transformed vertex buffer, in parallel over the vertices,
+// and the triangles are then assembled from that buffer through the index
+// the varyings of the vertex buffer are kept in varyings for the raster stage
+template <class Shader>
+	requires IndexedVertexShader<Shader>
+BinnedTriangles<shader_scalar_t<Shader>> assemble_indexed_faces(const VertexIndex& index, const Shader& prepared,
+	int width, int height, double sample_reach, ThreadPool& pool, const DrawOptions& options,
+	std::vector<typename Shader::Varyings>& varyings)
+{
+	constexpr int vertices_per_job = 512;
+	const int nfaces = index.corner_vertex.size() / 3;
+	const int nvertices = index.vertex_corner.size();
+
+	std::vector<vec<4, shader_scalar_t<Shader>>> positions(nvertices);
+	varyings.resize(nvertices);
+	pool.parallel_for((nvertices + vertices_per_job - 1) / vertices_per_job, [&](int job, unsigned int) {
+		const int end = std::min(nvertices, (job + 1) * vertices_per_job);
+		for (int vertex = job * vertices_per_job; vertex < end; vertex++) {
+			positions[vertex] = prepared.shade_vertex(vertex, varyings[vertex]);
+		}
+	});
+
+	BinnedTriangles<shader_scalar_t<Shader>> triangles(nfaces);
+	pool.parallel_for(triangles.parts.size(), [&](int job, unsigned int) {
+		const int end = std::min(nfaces, (job + 1) * ASSEMBLY_JOB_FACES);
+		for (int face = job * ASSEMBLY_JOB_FACES; face < end; face++) {
+			std::array<vec<4, shader_scalar_t<Shader>>, 3> clip_coords;
+			for (int nthvert = 0; nthvert < 3; nthvert++) {
+				clip_coords[nthvert] = positions[index.corner_vertex[3 * face + nthvert]];
+			}
+			assemble_binned_triangle(triangles.faces[face], triangles.parts[job], clip_coords, width, height,
+				options.cull, options.perspective, sample_reach);
+		}
+	});
+	return triangles;
+}
+
+// draw_tiled into canvas and zbuffer, which hold pattern.count samples of the width x height pixels
+// the triangles are loaded into the shaders of the workers by running vertex() on their corners again
+template <class pixel_T, class Shader, class depth_T>
+DrawStats draw_tiled_faces(int nfaces, const Shader& shader, Image<pixel_T>& canvas, Image<depth_T>& zbuffer,
+	int width, int height, const SamplePattern& pattern, double sample_reach, ThreadPool& pool, const DrawOptions& options)
+{
+	Shader prepared = shader;
+	if (options.setup_uniforms)
+		setup_shader_uniforms(prepared);
+	const BinnedTriangles<shader_scalar_t<Shader>> triangles
+		= assemble_faces(nfaces, prepared, width, height, sample_reach, pool, options);
+	const auto load_triangle = [](Shader& worker_shader, int face) {
+		for (int nthvert = 0; nthvert < 3; nthvert++) {
+			worker_shader.vertex(3 * face, nthvert);
+		}
+	};
+	DrawStats stats = draw_binned_triangles(
+		triangles, prepared, load_triangle, canvas, zbuffer, pattern, pool, options.deferred, options.rows_done);
+	stats.faces = nfaces;
+	stats.shaded_vertices = 3 * (nfaces + stats.triangle_loads);
+	return stats;
+}
+
+// draw_tiled_indexed into canvas and zbuffer, see draw_tiled_faces
+// the triangles are loaded into the shaders of the workers from the varyings of the vertex buffer
+template <class pixel_T, class Shader, class depth_T>
+	requires IndexedVertexShader<Shader>
+DrawStats draw_tiled_indexed_faces(const VertexIndex& index, const Shader& shader, Image<pixel_T>& canvas,
+	Image<depth_T>& zbuffer, int width, int height, const SamplePattern& pattern, double sample_reach, ThreadPool& pool,
+	const DrawOptions& options)
+{
+	Shader prepared = shader;
+	if (options.setup_uniforms)
+		setup_shader_uniforms(prepared);
+	std::vector<typename Shader::Varyings> varyings;
+	const BinnedTriangles<shader_scalar_t<Shader>> triangles
+		= assemble_indexed_faces(index, prepared, width, height, sample_reach, pool, options, varyings);
+	const auto load_triangle = [&](Shader& worker_shader, int face) {
+		for (int nthvert = 0; nthvert < 3; nthvert++) {
+			worker_shader.assemble_vertex(nthvert, varyings[index.corner_vertex[3 * face + nthvert]]);
+		}
+	};
+	DrawStats stats = draw_binned_triangles(
+		triangles, prepared, load_triangle, canvas, zbuffer, pattern, pool, options.deferred, options.rows_done);
+	stats.faces = triangles.faces.size();
+	stats.shaded_vertices = index.vertex_corner.size();
+	return stats;
+}
+
+// Draws faces [0, nfaces) of the model in three stages
+// after the per-draw uniform setup of the shader:
+// 1. vertex shader and primitive assembly, in parallel over the faces,
+//    triangles are clipped against the near and guard-band planes,
+//    faces facing away according to options.cull never reach the binning
+// 2. binning, each worker sorts a contiguous range of faces into the screen tiles
+// 3. rasterization, each tile is owned by one worker so the canvas needs no locks
+// 4. with options.deferred, shading of the visible pixels
+// Tiles are drawn in the face order, which makes the output identical to
+// calling draw_shaded_triangle for every face on a single thread
+// Shader::fragment must not modify the shader, every worker draws all
+// of its triangles with the same copy and only reloads their varyings
+// vertex() runs again for a triangle on every tile it is drawn in, an indexed shader
+// avoids that with draw_tiled_indexed, which keeps the varyings of its vertex buffer
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T>
+DrawStats draw_tiled(int nfaces, const Shader& shader, Image<pixel_T>& canvas, Image<depth_T>& zbuffer, ThreadPool& pool,
+	const DrawOptions& options = {})
+{
+	return draw_tiled_faces(
+		nfaces, shader, canvas, zbuffer, canvas.width, canvas.height, *sample_pattern(1), 0, pool, options);
+}
+
+// draw_tiled into a multisampled target, resolve it into a canvas afterwards
+// the fragment shader still runs once per pixel and triangle
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T>
+DrawStats draw_tiled(int nfaces, const Shader& shader, MultisampleTarget<pixel_T, depth_T>& target, ThreadPool& pool,
+	const DrawOptions& options = {})
+{
+	return draw_tiled_faces(nfaces, shader, target.color, target.depth, target.width, target.height,
+		*sample_pattern(target.samples), target.sample_reach(), pool, options);
+}
+
+// Same as draw_tiled, but the vertex stage runs once per unique vertex of the index
+// The output is identical to draw_tiled with the same shader
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T> && IndexedVertexShader<Shader>
+DrawStats draw_tiled_indexed(const VertexIndex& index, const Shader& shader, Image<pixel_T>& canvas,
+	Image<depth_T>& zbuffer, ThreadPool& pool, const DrawOptions& options = {})
+{
+	return draw_tiled_indexed_faces(
+		index, shader, canvas, zbuffer, canvas.width, canvas.height, *sample_pattern(1), 0, pool, options);
+}
+
+// draw_tiled_indexed into a multisampled target
+template <class pixel_T, class Shader, class depth_T>
+	requires FragmentShader<Shader, pixel_T> && IndexedVertexShader<Shader>
+DrawStats draw_tiled_indexed(const VertexIndex& index, const Shader& shader, MultisampleTarget<pixel_T, depth_T>& target,
+	ThreadPool& pool, const DrawOptions& options = {})
+{
+	return draw_tiled_indexed_faces(index, shader, target.color, target.depth, target.width, target.height,
+		*sample_pattern(target.samples), target.sample_reach(), pool, options);
+}
@@ -0,0 +1,4 @@
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o obj_face_indices ^
+ "src/testing/obj_face_indices.cpp" "src/parser.cpp" "src/mapped_file.cpp" "src/mesh_cache.cpp" "src/mat_vec.cpp" "src/thread_pool.cpp"
+g++ -O2 -static-libstdc++ -std=c++23 -Wall -Wextra -o texture_mips ^
+ "src/testing/texture_mips.cpp" "src/tgaimage.cpp" "src/mapped_file.cpp" "src/thread_pool.cpp"